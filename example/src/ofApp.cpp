@@ -1,4 +1,6 @@
 #include "ofApp.h"
+#include <chrono>
+#include <thread>
 
 void ofApp::setup() {
     ofLogToConsole();
@@ -15,11 +17,11 @@ void ofApp::setup() {
     // 遅延ロードフォント - 異なるサイズ
     // macOSではシステムフォント名を直接指定
 #ifdef TARGET_OS_MAC
-    string fontPath = "HiraMinProN-W3";  // macOS日本語フォント（ヒラギノ明朝）
+    fontPath = "HiraMinProN-W3";  // macOS日本語フォント（ヒラギノ明朝）
 #elif defined WIN32
-    string fontPath = "Meiryo.ttf";
+    fontPath = "Meiryo.ttf";
 #else
-    string fontPath = OF_TTF_SANS;
+    fontPath = OF_TTF_SANS;
 #endif
 
     ofLogNotice("ofApp") << "フォントをロード: " << fontPath;
@@ -33,6 +35,10 @@ void ofApp::setup() {
     fontShared1.load(fontPath, 32, true);
     fontShared2.load(fontPath, 32, true);
 
+    // 固定の文字列は一度だけレイアウトしておく
+    titleText = fontSmall.prepare("ofxTrueTypeFontLowRAM Example");
+    helpText = fontSmall.prepare("[1-5] テキスト切替  [S] 統計表示  [A] アトラス表示  [B] ベンチマーク");
+
     // 比較用の通常フォント（小さい文字セットのみ）
     // 注意: 日本語を含む全文字セットをロードするとメモリを大量消費
     fontNormal.load(fontPath, 32, true, false);  // fullCharSet = false
@@ -49,12 +55,12 @@ void ofApp::draw() {
 
     // タイトル
     ofSetColor(255, 200, 100);
-    fontSmall.drawString("ofxTrueTypeFontLowRAM Example", 20, y);
+    titleText.draw(20, y);
     y += 40;
 
     // 操作説明
     ofSetColor(150);
-    fontSmall.drawString("[1-5] テキスト切替  [S] 統計表示  [A] アトラス表示", 20, y);
+    helpText.draw(20, y);
     y += 50;
 
     // 現在のテスト文字列を表示
@@ -91,6 +97,9 @@ void ofApp::draw() {
 
     // 統計表示
     if (showStats) {
+        // 統計の各行はまとめて1回で描画する
+        ofxTrueTypeFontLowRAM::beginBatch();
+
         ofSetColor(100, 200, 255);
         y += 20;
         fontSmall.drawString("--- Statistics ---", 20, y);
@@ -100,21 +109,24 @@ void ofApp::draw() {
         stringstream ss;
         ss << "fontSmall:  " << fontSmall.getLoadedGlyphCount() << " glyphs, "
            << fontSmall.getAtlasCount() << " atlas(es), "
-           << (fontSmall.getMemoryUsage() / 1024) << " KB";
+           << (fontSmall.getMemoryUsage() / 1024) << " KB, fill "
+           << ofToString(fontSmall.getAtlasFillRatio() * 100, 1) << "%";
         fontSmall.drawString(ss.str(), 20, y);
         y += 22;
 
         ss.str("");
         ss << "fontMedium: " << fontMedium.getLoadedGlyphCount() << " glyphs, "
            << fontMedium.getAtlasCount() << " atlas(es), "
-           << (fontMedium.getMemoryUsage() / 1024) << " KB";
+           << (fontMedium.getMemoryUsage() / 1024) << " KB, fill "
+           << ofToString(fontMedium.getAtlasFillRatio() * 100, 1) << "%";
         fontSmall.drawString(ss.str(), 20, y);
         y += 22;
 
         ss.str("");
         ss << "fontLarge:  " << fontLarge.getLoadedGlyphCount() << " glyphs, "
            << fontLarge.getAtlasCount() << " atlas(es), "
-           << (fontLarge.getMemoryUsage() / 1024) << " KB";
+           << (fontLarge.getMemoryUsage() / 1024) << " KB, fill "
+           << ofToString(fontLarge.getAtlasFillRatio() * 100, 1) << "%";
         fontSmall.drawString(ss.str(), 20, y);
         y += 22;
 
@@ -127,14 +139,34 @@ void ofApp::draw() {
         // 総メモリ使用量
         ofSetColor(255, 200, 100);
         ss.str("");
-        ss << "Total Cache Memory: " << (ofxTrueTypeFontLowRAM::getTotalCacheMemoryUsage() / 1024) << " KB";
+        ss << "Total Cache Memory: " << (ofxTrueTypeFontLowRAM::getTotalCacheMemoryUsage() / 1024) << " KB, "
+           << ofxTrueTypeFontLowRAM::getOpenFaceCount() << " open face(s)";
         fontSmall.drawString(ss.str(), 20, y);
         y += 25;
 
+        // ラスタライズ待ちのグリフ（asyncRasterization使用時のみ）
+        if (fontLarge.getPendingGlyphCount() > 0) {
+            ss.str("");
+            ss << "Rasterizing: " << fontLarge.getPendingGlyphCount() << " glyphs pending";
+            fontSmall.drawString(ss.str(), 20, y);
+            y += 25;
+        }
+
+        // mmapしたフォントファイル（memoryMapFont使用時のみ）
+        if (ofxTrueTypeFontLowRAM::getMappedFontBytes() > 0) {
+            ss.str("");
+            ss << "Mapped Font Files: " << (ofxTrueTypeFontLowRAM::getMappedFontBytes() / 1024) << " KB mapped, "
+               << (ofxTrueTypeFontLowRAM::getResidentFontBytes() / 1024) << " KB resident";
+            fontSmall.drawString(ss.str(), 20, y);
+            y += 25;
+        }
+
         ofSetColor(150);
         ss.str("");
         ss << "FPS: " << ofToString(ofGetFrameRate(), 1);
         fontSmall.drawString(ss.str(), 20, y);
+
+        ofxTrueTypeFontLowRAM::endBatch();
     }
 
     // アトラステクスチャ表示
@@ -199,5 +231,199 @@ void ofApp::keyPressed(int key) {
         showStats = !showStats;
     } else if (key == 'a' || key == 'A') {
         showAtlas = !showAtlas;
+    } else if (key == 'b' || key == 'B') {
+        runBenchmark();
     }
 }
+
+// 1回あたりのナノ秒を計測
+template<typename F>
+static double measureNanosPerOp(size_t ops, F&& f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / double(ops);
+}
+
+void ofApp::runBenchmark() {
+    ofLogNotice("ofApp") << "--- Benchmark ---";
+
+    // グリフ表の引き: GlyphTable と unordered_map の比較
+    vector<pair<string, vector<uint32_t>>> corpora = {
+        {"Latin", {}},
+        {"CJK", {}},
+    };
+    for (auto c : ofUTF8Iterator(testStrings[2] + testStrings[3])) corpora[0].second.push_back(c);
+    for (auto c : ofUTF8Iterator(testStrings[1] + testStrings[4])) corpora[1].second.push_back(c);
+
+    const int iterations = 100000;
+    for (auto& [name, codepoints] : corpora) {
+        GlyphTable<LazyGlyphProps> table;
+        unordered_map<uint32_t, LazyGlyphProps> map;
+        for (auto c : codepoints) {
+            LazyGlyphProps props = {};
+            props.advance = float(c);
+            table.insert(c, props);
+            map[c] = props;
+        }
+
+        size_t ops = size_t(iterations) * codepoints.size();
+        volatile float sink = 0;
+        double tableNs = measureNanosPerOp(ops, [&] {
+            for (int i = 0; i < iterations; i++) {
+                for (auto c : codepoints) sink = sink + table.find(c)->advance;
+            }
+        });
+        double mapNs = measureNanosPerOp(ops, [&] {
+            for (int i = 0; i < iterations; i++) {
+                for (auto c : codepoints) sink = sink + map.find(c)->second.advance;
+            }
+        });
+        ofLogNotice("ofApp") << "Glyph lookup (" << name << "): GlyphTable "
+                             << ofToString(tableNs, 2) << " ns, unordered_map " << ofToString(mapNs, 2) << " ns";
+    }
+
+    // レイアウトのスループット（stringWidth、文字/秒）
+    const int layoutIterations = 20000;
+    for (auto& [name, codepoints] : corpora) {
+        string text = (name == "Latin") ? testStrings[2] : testStrings[1];
+        size_t chars = 0;
+        for ([[maybe_unused]] auto c : ofUTF8Iterator(text)) chars++;
+        fontMedium.stringWidth(text);  // グリフを先にロードしておく
+
+        volatile float sink = 0;
+        double ns = measureNanosPerOp(size_t(layoutIterations) * chars, [&] {
+            for (int i = 0; i < layoutIterations; i++) sink = sink + fontMedium.stringWidth(text);
+        });
+        ofLogNotice("ofApp") << "Layout (" << name << "): " << ofToString(1e3 / ns, 1) << " M chars/s";
+    }
+
+    // 複数スレッドからの計測（1, 2, 4, ...スレッドで同じフォントを同時にstringWidth）
+    // warm: ロード済みのグリフだけ（共有ロックのみ）
+    // cold: 毎回新しいサイズで、各スレッドが未ロードの漢字を取り合う（排他ロックとFreeTypeの直列化を含む）
+    string mixedText = testStrings[2] + testStrings[1] + testStrings[4];
+    size_t mixedChars = 0;
+    for ([[maybe_unused]] auto c : ofUTF8Iterator(mixedText)) mixedChars++;
+    string coldText;
+    for (uint32_t c = 0x4E00; c < 0x4E00 + 500; c++) ofUTF8Append(coldText, c);
+
+    size_t maxThreads = max(1u, thread::hardware_concurrency());
+    double warmBase = 0;
+    int coldSize = 41;  // 他のフォントが使っていないサイズ（共有キャッシュに残っていると計測がcoldにならない）
+    for (size_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        const int perThread = 20000;
+        fontMedium.stringWidth(mixedText);
+        double warmNs = measureNanosPerOp(threadCount * perThread * mixedChars, [&] {
+            vector<thread> workers;
+            for (size_t t = 0; t < threadCount; t++) {
+                workers.emplace_back([&] {
+                    volatile float sink = 0;
+                    for (int i = 0; i < perThread; i++) sink = sink + fontMedium.stringWidth(mixedText);
+                });
+            }
+            for (auto& worker : workers) worker.join();
+        });
+        if (threadCount == 1) warmBase = warmNs;
+
+        ofxTrueTypeFontLowRAM coldFont;
+        int size = coldSize++;
+        coldFont.load(fontPath, size, true);
+        double coldMs = measureNanosPerOp(1, [&] {
+            vector<thread> workers;
+            for (size_t t = 0; t < threadCount; t++) {
+                workers.emplace_back([&] { coldFont.stringWidth(coldText); });
+            }
+            for (auto& worker : workers) worker.join();
+        }) / 1e6;
+
+        ofLogNotice("ofApp") << "Concurrent layout (" << threadCount << " threads): warm "
+                             << ofToString(1e3 / warmNs, 1) << " M chars/s (x" << ofToString(warmBase / warmNs, 2)
+                             << "), cold " << ofToString(coldMs, 1) << " ms for 500 new glyphs";
+
+        // 次に[B]を押した時もcoldで計測できるように、キャッシュから外しておく
+        SharedFontCache::getInstance().release(FontCacheKey{fontPath, size, true});
+    }
+
+    // バッチの組み立て（CPUのみ、300ラベル分）
+    const int labelCount = 300;
+    const int batchIterations = 100;
+    TextBatch batch;
+    double batchNs = measureNanosPerOp(size_t(batchIterations) * labelCount, [&] {
+        for (int i = 0; i < batchIterations; i++) {
+            batch.clear();
+            for (int label = 0; label < labelCount; label++) {
+                fontSmall.addToBatch(batch, testStrings[2], 20, 20 + label * 2, ofFloatColor(1, 1, 1));
+            }
+        }
+    });
+    ofLogNotice("ofApp") << "Batch build: " << ofToString(batchNs / 1e3, 2) << " us/label, "
+                         << batch.getQuadCount() << " quads in " << batch.getGroups().size() << " group(s)";
+
+    // インスタンス描画用の組み立て（同じ300ラベル）
+    GlyphInstanceBuilder instances;
+    double instanceNs = measureNanosPerOp(size_t(batchIterations) * labelCount, [&] {
+        for (int i = 0; i < batchIterations; i++) {
+            instances.clear();
+            for (int label = 0; label < labelCount; label++) {
+                fontSmall.addToInstances(instances, testStrings[2], 20, 20 + label * 2, ofFloatColor(1, 1, 1));
+            }
+        }
+    });
+    size_t quadBytes = 4 * (sizeof(GlyphVertex) + sizeof(ofFloatColor)) + 6 * sizeof(ofIndexType);
+    ofLogNotice("ofApp") << "Instance build: " << ofToString(instanceNs / 1e3, 2) << " us/label, "
+                         << sizeof(GlyphInstance) << " bytes/glyph (quads: " << quadBytes << " bytes/glyph)";
+
+    // コマンドバッファ（同じ300ラベルを複数スレッドでレイアウトし、GLスレッドでまとめて送る）
+    size_t layoutThreads = max(1u, thread::hardware_concurrency());
+    vector<TextCommandBuffer> commandBuffers(layoutThreads);
+    double layoutNs = measureNanosPerOp(size_t(batchIterations) * labelCount, [&] {
+        for (int i = 0; i < batchIterations; i++) {
+            vector<thread> workers;
+            for (size_t t = 0; t < layoutThreads; t++) {
+                workers.emplace_back([&, t] {
+                    TextCommandBuffer& buffer = commandBuffers[t];
+                    buffer.clear();
+                    for (int label = int(t); label < labelCount; label += int(layoutThreads)) {
+                        fontSmall.addToCommandBuffer(buffer, testStrings[2], 20, 20 + label * 2,
+                                                     ofFloatColor(1, 1, 1));
+                    }
+                });
+            }
+            for (auto& worker : workers) worker.join();
+        }
+    });
+    double submitNs = measureNanosPerOp(size_t(batchIterations) * labelCount, [&] {
+        for (int i = 0; i < batchIterations; i++) {
+            batch.clear();
+            for (const auto& buffer : commandBuffers) buffer.submit(batch);
+        }
+    });
+    ofLogNotice("ofApp") << "Command buffers (" << layoutThreads << " threads): layout "
+                         << ofToString(layoutNs / 1e3, 2) << " us/label, submit " << ofToString(submitNs / 1e3, 2)
+                         << " us/label (batch build: " << ofToString(batchNs / 1e3, 2) << "), "
+                         << batch.getQuadCount() << " quads in " << batch.getGroups().size() << " group(s)";
+
+    // 大きな文字セットのロード: 1文字ずつ vs preload（CJK統合漢字の先頭から）
+    // 共有キャッシュに載らないよう、それぞれ他で使っていないサイズでロードする
+    std::u32string kanji;
+    for (char32_t c = 0x4E00; c < 0x4E00 + 3000; c++) kanji.push_back(c);
+
+    ofxTrueTypeFontLowRAM serialFont;
+    serialFont.load(fontPath, 23, true);
+    auto serialManager = serialFont.getAtlasManager();
+    double serialNs = measureNanosPerOp(kanji.size(), [&] {
+        for (auto c : kanji) serialManager->getOrLoadGlyph(c);
+        serialManager->flushUploads();
+    });
+
+    ofxTrueTypeFontLowRAM preloadFont;
+    preloadFont.load(fontPath, 25, true);
+    size_t preloaded = 0;
+    double preloadNs = measureNanosPerOp(kanji.size(), [&] {
+        preloaded = preloadFont.preload(kanji);
+        preloadFont.getAtlasManager()->flushUploads();
+    });
+    ofLogNotice("ofApp") << "Load " << kanji.size() << " kanji: one by one "
+                         << ofToString(serialNs * kanji.size() / 1e6, 1) << " ms, preload "
+                         << ofToString(preloadNs * kanji.size() / 1e6, 1) << " ms (" << preloaded << " glyphs)";
+}
@@ -10,6 +10,9 @@ public:
     void draw();
     void keyPressed(int key);
 
+    // ベンチマーク（[B]キー、結果はコンソールに出力）
+    void runBenchmark();
+
 private:
     // 遅延ロードフォント
     ofxTrueTypeFontLowRAM fontSmall;
@@ -20,9 +23,16 @@ private:
     ofxTrueTypeFontLowRAM fontShared1;
     ofxTrueTypeFontLowRAM fontShared2;
 
+    // 毎フレーム変わらない文字列はレイアウト済みのものを使う
+    ofxTrueTypeFontLowRAM::PreparedText titleText;
+    ofxTrueTypeFontLowRAM::PreparedText helpText;
+
     // 通常のofTrueTypeFont（比較用）
     ofTrueTypeFont fontNormal;
 
+    // 使用しているフォント（ベンチマークで別サイズをロードする時に使う）
+    string fontPath;
+
     // 描画する文字列
     string testStrings[5];
     int currentStringIndex = 0;
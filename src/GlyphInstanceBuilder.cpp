@@ -0,0 +1,54 @@
+#include "GlyphInstanceBuilder.h"
+#include "ofxTrueTypeFontLowRAM.h"
+
+using namespace std;
+
+GlyphInstanceBuilder::Group& GlyphInstanceBuilder::getGroup(FontAtlasManager* manager, size_t atlasIndex) {
+    uint64_t releaseCount = manager->getAtlasReleaseCount();
+
+    // 同じアトラスへの追加が続くことが多いので、直前のグループを先に見る
+    if (lastGroup < groups.size()) {
+        Group& last = groups[lastGroup];
+        if (last.manager == manager && last.atlasIndex == atlasIndex && last.atlasReleaseCount == releaseCount) {
+            return last;
+        }
+    }
+
+    size_t freeGroup = SIZE_MAX;
+    for (size_t i = 0; i < groups.size(); i++) {
+        Group& group = groups[i];
+        if (group.manager == manager && group.atlasIndex == atlasIndex && group.atlasReleaseCount == releaseCount) {
+            lastGroup = i;
+            return group;
+        }
+        if (!group.manager && freeGroup == SIZE_MAX) {
+            freeGroup = i;
+        }
+    }
+
+    if (freeGroup == SIZE_MAX) {
+        freeGroup = groups.size();
+        groups.emplace_back();
+    }
+
+    Group& group = groups[freeGroup];
+    group.manager = manager;
+    group.atlasIndex = atlasIndex;
+    group.atlasReleaseCount = releaseCount;
+    lastGroup = freeGroup;
+    return group;
+}
+
+void GlyphInstanceBuilder::addGlyph(FontAtlasManager* manager, size_t atlasIndex, const GlyphInstance& instance) {
+    getGroup(manager, atlasIndex).instances.push_back(instance);
+    instanceCount++;
+}
+
+void GlyphInstanceBuilder::clear() {
+    for (auto& group : groups) {
+        group.manager = nullptr;
+        group.instances.clear();
+    }
+    lastGroup = 0;
+    instanceCount = 0;
+}
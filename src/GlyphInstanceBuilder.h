@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ofMesh.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class FontAtlasManager;
+
+// インスタンス描画用のグリフ1つ分の情報（48バイト）
+// 頂点4つ + インデックス6つの代わりにこれを1つ送り、シェーダーで単位クアッドを広げる
+// テクスチャ上の位置はピクセル座標で持つので、アトラスが拡張されても書き換え不要
+struct GlyphInstance {
+    float x, y;            // クアッドの左上（vFlippedでない場合は左下）
+    float atlasX, atlasY;  // アトラス上の位置（ピクセル）
+    float width, height;   // クアッドの大きさ（上下反転時はheightが負）
+    float atlasWidth, atlasHeight;  // アトラス上の大きさ（ピクセル）。ヒンティングなどでクアッドとは一致しない
+    ofFloatColor color;
+};
+
+// インスタンス描画用のグリフ情報を（アトラス管理, アトラス番号）ごとに集める
+// GLは使わないので、GPUなしで組み立て結果を確認できる。描画はGlyphInstanceRendererで行う
+class GlyphInstanceBuilder {
+public:
+    struct Group {
+        FontAtlasManager* manager = nullptr;
+        size_t atlasIndex = 0;
+        uint64_t atlasReleaseCount = 0;  // アトラス番号が詰められたら描画できない
+        std::vector<GlyphInstance> instances;
+    };
+
+    void addGlyph(FontAtlasManager* manager, size_t atlasIndex, const GlyphInstance& instance);
+
+    // 追加したグリフを全て削除（確保済みの配列は再利用する）
+    void clear();
+
+    size_t getInstanceCount() const { return instanceCount; }
+    bool empty() const { return instanceCount == 0; }
+
+    // 使用中のグループ（manager == nullptrのものは空き）
+    const std::vector<Group>& getGroups() const { return groups; }
+
+private:
+    std::vector<Group> groups;
+    size_t lastGroup = 0;
+    size_t instanceCount = 0;
+
+    Group& getGroup(FontAtlasManager* manager, size_t atlasIndex);
+};
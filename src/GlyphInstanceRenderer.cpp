@@ -0,0 +1,148 @@
+#include "GlyphInstanceRenderer.h"
+#include "ofxTrueTypeFontLowRAM.h"
+#include "ofGLUtils.h"
+
+#include <cstddef>
+
+using namespace std;
+
+// インスタンスごとの属性の位置（ofShaderの既定の属性と重ならない番号）
+static const int glyphPositionAttribute = 5;  // x, y, atlasX, atlasY
+static const int glyphSizeAttribute = 6;      // width, height, atlasWidth, atlasHeight
+static const int glyphColorAttribute = 7;
+
+#ifdef TARGET_OPENGLES
+static const char* shaderHeader = "#version 300 es\nprecision highp float;\n";
+#else
+static const char* shaderHeader = "#version 150\n";
+#endif
+
+static const char* vertexShaderBody = R"(
+uniform mat4 modelViewProjectionMatrix;
+uniform vec2 atlasSize;
+
+in vec4 position;       // 単位クアッドの角（0〜1）
+in vec4 glyphPosition;  // xy: クアッドの左上, zw: アトラス上の位置（ピクセル）
+in vec4 glyphSize;      // xy: クアッドの大きさ（上下反転時はyが負）, zw: アトラス上の大きさ（ピクセル）
+in vec4 glyphColor;
+
+out vec2 texCoord;
+out vec4 color;
+
+void main() {
+    vec2 corner = position.xy;
+    texCoord = (glyphPosition.zw + corner * glyphSize.zw) / atlasSize;
+    color = glyphColor;
+    gl_Position = modelViewProjectionMatrix * vec4(glyphPosition.xy + corner * glyphSize.xy, 0.0, 1.0);
+}
+)";
+
+static const char* fragmentShaderBody = R"(
+uniform sampler2D atlas;
+
+in vec2 texCoord;
+in vec4 color;
+
+out vec4 fragColor;
+
+void main() {
+    fragColor = texture(atlas, texCoord) * color;
+}
+)";
+
+bool GlyphInstanceRenderer::isSupported() {
+    return ofIsGLProgrammableRenderer();
+}
+
+bool GlyphInstanceRenderer::setup() {
+    setupTried = true;
+
+    if (!isSupported()) {
+        ofLogWarning("GlyphInstanceRenderer") << "Instanced drawing requires the programmable renderer";
+        return false;
+    }
+
+    shader.setupShaderFromSource(GL_VERTEX_SHADER, string(shaderHeader) + vertexShaderBody);
+    shader.setupShaderFromSource(GL_FRAGMENT_SHADER, string(shaderHeader) + fragmentShaderBody);
+    shader.bindDefaults();
+    shader.bindAttribute(glyphPositionAttribute, "glyphPosition");
+    shader.bindAttribute(glyphSizeAttribute, "glyphSize");
+    shader.bindAttribute(glyphColorAttribute, "glyphColor");
+    if (!shader.linkProgram()) {
+        ofLogError("GlyphInstanceRenderer") << "Failed to link the glyph shader";
+        return false;
+    }
+
+    // 三角形ストリップの単位クアッド
+    const float corners[] = {0, 0, 1, 0, 0, 1, 1, 1};
+    quadBuffer.setData(sizeof(corners), corners, GL_STATIC_DRAW);
+    vbo.setVertexBuffer(quadBuffer, 2, sizeof(float) * 2);
+
+    return true;
+}
+
+void GlyphInstanceRenderer::setInstanceAttributes(size_t firstInstance) {
+    int stride = sizeof(GlyphInstance);
+    int offset = int(firstInstance * sizeof(GlyphInstance));
+    vbo.setAttributeBuffer(glyphPositionAttribute, instanceBuffer, 4, stride, offset + int(offsetof(GlyphInstance, x)));
+    vbo.setAttributeBuffer(glyphSizeAttribute, instanceBuffer, 4, stride, offset + int(offsetof(GlyphInstance, width)));
+    vbo.setAttributeBuffer(glyphColorAttribute, instanceBuffer, 4, stride, offset + int(offsetof(GlyphInstance, color)));
+    vbo.setAttributeDivisor(glyphPositionAttribute, 1);
+    vbo.setAttributeDivisor(glyphSizeAttribute, 1);
+    vbo.setAttributeDivisor(glyphColorAttribute, 1);
+}
+
+void GlyphInstanceRenderer::draw(const GlyphInstanceBuilder& builder) {
+    if (builder.empty()) return;
+    if (!setupTried) {
+        ready = setup();
+    }
+    if (!ready) return;
+
+    // 全グループを1本のバッファに続けて転送する
+    size_t total = builder.getInstanceCount();
+    if (total > instanceCapacity) {
+        instanceCapacity = max(total, instanceCapacity * 2);
+        instanceBuffer.allocate(instanceCapacity * sizeof(GlyphInstance), GL_DYNAMIC_DRAW);
+    }
+
+    vector<FontAtlasManager*> flushed;
+    size_t offset = 0;
+    for (const auto& group : builder.getGroups()) {
+        if (!group.manager || group.instances.empty()) continue;
+        instanceBuffer.updateData(offset * sizeof(GlyphInstance), group.instances.size() * sizeof(GlyphInstance),
+                                  group.instances.data());
+        offset += group.instances.size();
+
+        // 未転送のグリフはアトラス管理ごとに1回だけ転送する
+        if (find(flushed.begin(), flushed.end(), group.manager) == flushed.end()) {
+            group.manager->flushUploads();
+            flushed.push_back(group.manager);
+        }
+    }
+
+    ScopedTextBlend blend;
+    shader.begin();
+
+    offset = 0;
+    for (const auto& group : builder.getGroups()) {
+        if (!group.manager || group.instances.empty()) continue;
+        size_t first = offset;
+        offset += group.instances.size();
+
+        // 組み立て中にアトラスが解放されると番号がずれるので描画しない
+        if (group.atlasReleaseCount != group.manager->getAtlasReleaseCount()) {
+            ofLogWarning("GlyphInstanceRenderer") << "draw(): atlas was released while building, skipped "
+                                                  << group.instances.size() << " glyphs";
+            continue;
+        }
+
+        shader.setUniformTexture("atlas", group.manager->getTexture(group.atlasIndex), 0);
+        shader.setUniform2f("atlasSize", group.manager->getAtlasWidth(group.atlasIndex),
+                            group.manager->getAtlasHeight(group.atlasIndex));
+        setInstanceAttributes(first);
+        vbo.drawInstanced(GL_TRIANGLE_STRIP, 0, 4, int(group.instances.size()));
+    }
+
+    shader.end();
+}
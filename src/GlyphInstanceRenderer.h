@@ -0,0 +1,30 @@
+#pragma once
+
+#include "GlyphInstanceBuilder.h"
+
+// GlyphInstanceBuilderの内容をインスタンス描画する
+// 単位クアッド1つを全グリフで共有し、グリフごとの情報（GlyphInstance）だけを転送する
+// プログラマブルレンダラー（GL3以上 / GLES3）が必要
+class GlyphInstanceRenderer {
+public:
+    // インスタンス描画が使えるか
+    static bool isSupported();
+
+    // アトラスごとに1回ずつ描画（未転送のグリフもここで転送される）
+    void draw(const GlyphInstanceBuilder& builder);
+
+    // GPU側で確保しているインスタンスバッファのバイト数
+    size_t getBufferBytes() const { return instanceCapacity * sizeof(GlyphInstance); }
+
+private:
+    ofShader shader;
+    ofBufferObject quadBuffer;      // 単位クアッド（三角形ストリップ）
+    ofBufferObject instanceBuffer;
+    size_t instanceCapacity = 0;
+    ofVbo vbo;
+    bool setupTried = false;
+    bool ready = false;
+
+    bool setup();
+    void setInstanceAttributes(size_t firstInstance);
+};
@@ -0,0 +1,250 @@
+#include "GlyphPacker.h"
+
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+// ===========================================================================
+// GlyphPacker 共通部分
+// ===========================================================================
+
+unique_ptr<GlyphPacker> GlyphPacker::create(GlyphPackerType type) {
+    switch (type) {
+        case GlyphPackerType::Shelf:
+            return make_unique<ShelfGlyphPacker>();
+        case GlyphPackerType::Skyline:
+        default:
+            return make_unique<SkylineGlyphPacker>();
+    }
+}
+
+void GlyphPacker::reset(int w, int h, int b) {
+    width = w;
+    height = h;
+    border = b;
+    usedArea = 0;
+    onReset(width - border, height - border);
+}
+
+void GlyphPacker::grow(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    onGrow(width - border, height - border);
+}
+
+bool GlyphPacker::pack(int w, int h, int& outX, int& outY) {
+    // 右下のボーダー分を含めて内側の領域に確保
+    int x, y;
+    if (!packInner(w + border, h + border, x, y)) {
+        return false;
+    }
+    outX = x + border;
+    outY = y + border;
+    usedArea += size_t(w) * h;
+    return true;
+}
+
+void GlyphPacker::saveState(vector<int64_t>& out) const {
+    out.clear();
+    out.push_back(width);
+    out.push_back(height);
+    out.push_back(border);
+    out.push_back(int64_t(usedArea));
+    onSaveState(out);
+}
+
+bool GlyphPacker::loadState(const vector<int64_t>& state) {
+    // ファイルから読んだ値なので、配置がアトラスの外に出ないことを確かめてから使う
+    if (state.size() < 4) return false;
+    if (state[0] <= 0 || state[1] <= 0 || state[2] < 0 || state[0] > INT_MAX || state[1] > INT_MAX ||
+        state[2] >= min(state[0], state[1]) || state[3] < 0 || state[3] > state[0] * state[1]) {
+        return false;
+    }
+    width = int(state[0]);
+    height = int(state[1]);
+    border = int(state[2]);
+    usedArea = size_t(state[3]);
+    return onLoadState(state.data() + 4, state.size() - 4);
+}
+
+float GlyphPacker::getFillRatio() const {
+    if (width <= 0 || height <= 0) return 0.0f;
+    return float(double(usedArea) / (double(width) * height));
+}
+
+// ===========================================================================
+// ShelfGlyphPacker
+// ===========================================================================
+
+void ShelfGlyphPacker::onReset(int w, int h) {
+    innerWidth = w;
+    innerHeight = h;
+    currentX = 0;
+    currentY = 0;
+    currentRowHeight = 0;
+}
+
+void ShelfGlyphPacker::onGrow(int w, int h) {
+    innerWidth = w;
+    innerHeight = h;
+}
+
+bool ShelfGlyphPacker::packInner(int w, int h, int& outX, int& outY) {
+    if (w > innerWidth) return false;
+
+    // 現在の行に収まらなければ次の行へ
+    int x = currentX;
+    int y = currentY;
+    int rowHeight = currentRowHeight;
+    if (x + w > innerWidth) {
+        x = 0;
+        y += rowHeight;
+        rowHeight = 0;
+    }
+
+    // 高さが足りなければ失敗（状態は変えない）
+    if (y + h > innerHeight) {
+        return false;
+    }
+
+    outX = x;
+    outY = y;
+    currentX = x + w;
+    currentY = y;
+    currentRowHeight = max(rowHeight, h);
+    return true;
+}
+
+void ShelfGlyphPacker::onSaveState(vector<int64_t>& out) const {
+    out.insert(out.end(), {innerWidth, innerHeight, currentX, currentY, currentRowHeight});
+}
+
+bool ShelfGlyphPacker::onLoadState(const int64_t* data, size_t count) {
+    if (count != 5) return false;
+    if (data[0] != width - border || data[1] != height - border) return false;
+    if (data[2] < 0 || data[2] > data[0] || data[3] < 0 || data[4] < 0 || data[3] + data[4] > data[1]) return false;
+    innerWidth = int(data[0]);
+    innerHeight = int(data[1]);
+    currentX = int(data[2]);
+    currentY = int(data[3]);
+    currentRowHeight = int(data[4]);
+    return true;
+}
+
+// ===========================================================================
+// SkylineGlyphPacker
+// ===========================================================================
+
+void SkylineGlyphPacker::onReset(int w, int h) {
+    innerWidth = w;
+    innerHeight = h;
+    skyline.clear();
+    skyline.push_back({0, 0, w});
+}
+
+void SkylineGlyphPacker::onGrow(int w, int h) {
+    // 右側に増えた分は高さ0の区間として追加
+    if (w > innerWidth) {
+        skyline.push_back({innerWidth, 0, w - innerWidth});
+    }
+    innerWidth = w;
+    innerHeight = h;
+}
+
+int SkylineGlyphPacker::fit(size_t index, int w, int h) const {
+    int x = skyline[index].x;
+    if (x + w > innerWidth) return -1;
+
+    // 幅wがかかる区間の最大の高さが底になる
+    int y = 0;
+    int remaining = w;
+    for (size_t i = index; remaining > 0; i++) {
+        y = max(y, skyline[i].y);
+        if (y + h > innerHeight) return -1;
+        remaining -= skyline[i].width;
+    }
+    return y;
+}
+
+bool SkylineGlyphPacker::packInner(int w, int h, int& outX, int& outY) {
+    // 底が最も低くなる位置を選ぶ（同じなら幅の狭い区間を優先して隙間を埋める）
+    int bestBottom = INT_MAX;
+    int bestWidth = INT_MAX;
+    size_t bestIndex = SIZE_MAX;
+    int bestY = 0;
+
+    for (size_t i = 0; i < skyline.size(); i++) {
+        int y = fit(i, w, h);
+        if (y < 0) continue;
+        int bottom = y + h;
+        if (bottom < bestBottom || (bottom == bestBottom && skyline[i].width < bestWidth)) {
+            bestBottom = bottom;
+            bestWidth = skyline[i].width;
+            bestIndex = i;
+            bestY = y;
+        }
+    }
+
+    if (bestIndex == SIZE_MAX) {
+        return false;
+    }
+
+    outX = skyline[bestIndex].x;
+    outY = bestY;
+
+    // 新しい区間を挿入し、覆われた区間を削る
+    Node node = {outX, bestY + h, w};
+    skyline.insert(skyline.begin() + bestIndex, node);
+
+    for (size_t i = bestIndex + 1; i < skyline.size(); i++) {
+        Node& prev = skyline[i - 1];
+        Node& cur = skyline[i];
+        if (cur.x >= prev.x + prev.width) break;
+
+        int shrink = prev.x + prev.width - cur.x;
+        cur.x += shrink;
+        cur.width -= shrink;
+        if (cur.width > 0) break;
+
+        skyline.erase(skyline.begin() + i);
+        i--;
+    }
+
+    // 同じ高さの隣接区間を結合
+    for (size_t i = 0; i + 1 < skyline.size(); i++) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+            i--;
+        }
+    }
+
+    return true;
+}
+
+void SkylineGlyphPacker::onSaveState(vector<int64_t>& out) const {
+    out.push_back(innerWidth);
+    out.push_back(innerHeight);
+    for (const auto& node : skyline) {
+        out.insert(out.end(), {node.x, node.y, node.width});
+    }
+}
+
+bool SkylineGlyphPacker::onLoadState(const int64_t* data, size_t count) {
+    if (count < 2 || (count - 2) % 3 != 0) return false;
+    if (data[0] != width - border || data[1] != height - border) return false;
+    innerWidth = int(data[0]);
+    innerHeight = int(data[1]);
+
+    // 区間は左から隙間なく並び、内側の幅をちょうど覆う
+    skyline.clear();
+    int64_t nextX = 0;
+    for (size_t i = 2; i < count; i += 3) {
+        if (data[i] != nextX || data[i + 1] < 0 || data[i + 1] > innerHeight || data[i + 2] <= 0) return false;
+        nextX += data[i + 2];
+        if (nextX > innerWidth) return false;
+        skyline.push_back({int(data[i]), int(data[i + 1]), int(data[i + 2])});
+    }
+    return !skyline.empty() && nextX == innerWidth;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// グリフのパッキング方式
+enum class GlyphPackerType {
+    Shelf,    // 行（棚）単位で左から詰める。単純だが高さの違うグリフが混ざると無駄が多い
+    Skyline   // スカイライン（bottom-left）。高さの違うグリフを隙間に詰められる
+};
+
+// アトラス内の矩形割り当て
+// 座標はアトラスのピクセル座標。グリフ同士・アトラス端との間にborder分の隙間を空ける
+class GlyphPacker {
+public:
+    virtual ~GlyphPacker() = default;
+
+    // 空のアトラスとして初期化
+    void reset(int width, int height, int border);
+
+    // アトラスを拡張（既存の配置はそのまま）
+    void grow(int newWidth, int newHeight);
+
+    // w×hのグリフを配置できる位置を探して確保する
+    bool pack(int w, int h, int& outX, int& outY);
+
+    // 確保済みのグリフ面積（ボーダーを除く）
+    size_t getUsedArea() const { return usedArea; }
+
+    // 充填率（確保済み面積 / アトラス面積）
+    float getFillRatio() const;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // 配置の状態を書き出す・復元する（アトラスのディスクキャッシュ用）
+    // 復元は同じ種類のパッカーで行うこと（内容が合わなければfalse）
+    void saveState(std::vector<int64_t>& out) const;
+    bool loadState(const std::vector<int64_t>& state);
+
+    static std::unique_ptr<GlyphPacker> create(GlyphPackerType type);
+
+protected:
+    // ボーダーを除いた内側の領域での初期化・拡張・確保
+    // w, hには右下のボーダー分が含まれる
+    virtual void onReset(int innerWidth, int innerHeight) = 0;
+    virtual void onGrow(int innerWidth, int innerHeight) = 0;
+    virtual bool packInner(int w, int h, int& outX, int& outY) = 0;
+    virtual void onSaveState(std::vector<int64_t>& out) const = 0;
+    virtual bool onLoadState(const int64_t* data, size_t count) = 0;
+
+    int width = 0;
+    int height = 0;
+    int border = 0;
+    size_t usedArea = 0;
+};
+
+// 行（棚）パッカー
+class ShelfGlyphPacker : public GlyphPacker {
+protected:
+    void onReset(int innerWidth, int innerHeight) override;
+    void onGrow(int innerWidth, int innerHeight) override;
+    bool packInner(int w, int h, int& outX, int& outY) override;
+    void onSaveState(std::vector<int64_t>& out) const override;
+    bool onLoadState(const int64_t* data, size_t count) override;
+
+private:
+    int innerWidth = 0;
+    int innerHeight = 0;
+    int currentX = 0;
+    int currentY = 0;
+    int currentRowHeight = 0;
+};
+
+// スカイライン（bottom-left）パッカー
+class SkylineGlyphPacker : public GlyphPacker {
+protected:
+    void onReset(int innerWidth, int innerHeight) override;
+    void onGrow(int innerWidth, int innerHeight) override;
+    bool packInner(int w, int h, int& outX, int& outY) override;
+    void onSaveState(std::vector<int64_t>& out) const override;
+    bool onLoadState(const int64_t* data, size_t count) override;
+
+private:
+    // スカイラインの1区間（xからwidthの範囲の高さがy）
+    struct Node {
+        int x;
+        int y;
+        int width;
+    };
+    std::vector<Node> skyline;
+    int innerWidth = 0;
+    int innerHeight = 0;
+
+    // index番目の区間から幅wを置いた時の底のy（置けなければ-1）
+    int fit(size_t index, int w, int h) const;
+};
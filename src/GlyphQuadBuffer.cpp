@@ -0,0 +1,174 @@
+#include "GlyphQuadBuffer.h"
+#include "ofGLUtils.h"
+
+#include <cstddef>
+#include <limits>
+
+using namespace std;
+
+GlyphQuadBuffer::GlyphQuadBuffer(const GlyphQuadBuffer& other)
+    : vertices(other.vertices), colors(other.colors) {
+}
+
+GlyphQuadBuffer& GlyphQuadBuffer::operator=(const GlyphQuadBuffer& other) {
+    if (this != &other) {
+        vertices = other.vertices;
+        colors = other.colors;
+        dirty = true;
+    }
+    return *this;
+}
+
+void GlyphQuadBuffer::reserve(size_t quadCount) {
+    vertices.reserve(quadCount * 4);
+}
+
+void GlyphQuadBuffer::clear() {
+    vertices.clear();
+    colors.clear();
+    dirty = true;
+}
+
+void GlyphQuadBuffer::addQuad(const GlyphQuad& quad) {
+    pushVertices(quad);
+    if (!colors.empty()) {
+        colors.insert(colors.end(), 4, ofFloatColor(1, 1, 1, 1));
+    }
+}
+
+void GlyphQuadBuffer::addQuad(const GlyphQuad& quad, const ofFloatColor& color) {
+    // 色なしのクアッドが先にあれば白で埋める
+    colors.resize(vertices.size(), ofFloatColor(1, 1, 1, 1));
+    pushVertices(quad);
+    colors.insert(colors.end(), 4, color);
+}
+
+void GlyphQuadBuffer::pushVertices(const GlyphQuad& quad) {
+    vertices.push_back({quad.x0, quad.y0, quad.u0, quad.v0});
+    vertices.push_back({quad.x1, quad.y0, quad.u1, quad.v0});
+    vertices.push_back({quad.x1, quad.y1, quad.u1, quad.v1});
+    vertices.push_back({quad.x0, quad.y1, quad.u0, quad.v1});
+    dirty = true;
+}
+
+void GlyphQuadBuffer::appendToMesh(ofMesh& mesh) const {
+    ofIndexType firstIndex = mesh.getVertices().size();
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const GlyphVertex& vertex = vertices[i];
+        mesh.addVertex(glm::vec3(vertex.x, vertex.y, 0.f));
+        mesh.addTexCoord(glm::vec2(vertex.u, vertex.v));
+        if (!colors.empty()) {
+            mesh.addColor(colors[i]);
+        }
+    }
+    for (size_t quad = 0; quad < getQuadCount(); quad++) {
+        ofIndexType base = firstIndex + ofIndexType(quad * 4);
+        mesh.addIndex(base);
+        mesh.addIndex(base + 1);
+        mesh.addIndex(base + 2);
+        mesh.addIndex(base + 2);
+        mesh.addIndex(base + 3);
+        mesh.addIndex(base);
+    }
+}
+
+ofBufferObject& GlyphQuadBuffer::getSharedIndexBuffer(size_t quadCount) {
+    static ofBufferObject indexBuffer;
+    static size_t indexQuadCount = 0;
+
+    if (quadCount > indexQuadCount) {
+        // 倍々で増やす（バッファのIDは変わらないので、設定済みのVBOもそのまま使える）
+        size_t newCount = max<size_t>(quadCount, max<size_t>(indexQuadCount * 2, 256));
+        vector<ofIndexType> indices;
+        indices.reserve(newCount * 6);
+        for (size_t quad = 0; quad < newCount; quad++) {
+            ofIndexType base = ofIndexType(quad * 4);
+            indices.push_back(base);
+            indices.push_back(base + 1);
+            indices.push_back(base + 2);
+            indices.push_back(base + 2);
+            indices.push_back(base + 3);
+            indices.push_back(base);
+        }
+        indexBuffer.setData(indices.size() * sizeof(ofIndexType), indices.data(), GL_STATIC_DRAW);
+        indexQuadCount = newCount;
+    }
+    return indexBuffer;
+}
+
+void GlyphQuadBuffer::upload() const {
+    size_t count = vertices.size();
+
+    // 足りない時だけ倍々で確保し直す（普段は既存の領域に書き込むだけ）
+    if (count > vertexCapacity) {
+        vertexCapacity = max(count, vertexCapacity * 2);
+        vertexBuffer.allocate(vertexCapacity * sizeof(GlyphVertex), GL_DYNAMIC_DRAW);
+    }
+    vertexBuffer.updateData(0, count * sizeof(GlyphVertex), vertices.data());
+
+    if (!colors.empty()) {
+        if (colors.size() > colorCapacity) {
+            colorCapacity = max(colors.size(), colorCapacity * 2);
+            colorBuffer.allocate(colorCapacity * sizeof(ofFloatColor), GL_DYNAMIC_DRAW);
+        }
+        colorBuffer.updateData(0, colors.size() * sizeof(ofFloatColor), colors.data());
+    }
+
+    dirty = false;
+}
+
+void GlyphQuadBuffer::setAttributes(size_t firstVertex) const {
+    int stride = sizeof(GlyphVertex);
+    int offset = int(firstVertex * sizeof(GlyphVertex));
+    vbo.setVertexBuffer(vertexBuffer, 2, stride, offset);
+    vbo.setTexCoordBuffer(vertexBuffer, stride, offset + int(offsetof(GlyphVertex, u)));
+    if (!colors.empty()) {
+        vbo.setColorBuffer(colorBuffer, sizeof(ofFloatColor), int(firstVertex * sizeof(ofFloatColor)));
+        vbo.enableColors();
+    } else {
+        vbo.disableColors();
+    }
+}
+
+void GlyphQuadBuffer::draw() const {
+    if (vertices.empty()) return;
+
+    size_t previousCapacity = vertexCapacity;
+    size_t previousColorCapacity = colorCapacity;
+    if (dirty) {
+        upload();
+    }
+
+    // 16bitインデックスの環境では1回に描けるクアッド数に上限がある
+    const size_t maxQuadsPerDraw = (size_t(numeric_limits<ofIndexType>::max()) + 1) / 4;
+    size_t quadCount = getQuadCount();
+    size_t indexQuads = min(quadCount, maxQuadsPerDraw);
+    ofBufferObject& indices = getSharedIndexBuffer(indexQuads);
+
+    // バッファを確保し直した時と色の有無が変わった時だけ属性を設定し直す
+    bool hasColors = !colors.empty();
+    if (!attributesSet || vertexCapacity != previousCapacity || colorCapacity != previousColorCapacity ||
+        hasColors != attributesHaveColors) {
+        setAttributes(0);
+        vbo.setIndexBuffer(indices);
+        attributesSet = true;
+        attributesHaveColors = hasColors;
+    }
+
+    if (quadCount <= maxQuadsPerDraw) {
+        vbo.drawElements(GL_TRIANGLES, int(quadCount * 6));
+        return;
+    }
+
+    for (size_t first = 0; first < quadCount; first += maxQuadsPerDraw) {
+        size_t count = min(maxQuadsPerDraw, quadCount - first);
+        setAttributes(first * 4);
+        vbo.drawElements(GL_TRIANGLES, int(count * 6));
+    }
+    setAttributes(0);
+}
+
+size_t GlyphQuadBuffer::getMemoryUsage() const {
+    return vertices.capacity() * sizeof(GlyphVertex) + colors.capacity() * sizeof(ofFloatColor) +
+           vertexCapacity * sizeof(GlyphVertex) + colorCapacity * sizeof(ofFloatColor);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ofMesh.h"
+#include <vector>
+#include <cstddef>
+
+// グリフ1つ分のクアッド（画面座標とテクスチャ座標）
+struct GlyphQuad {
+    float x0, y0, x1, y1;  // 左上・右下（vFlippedでない場合は上下が逆になる）
+    float u0, v0, u1, v1;
+};
+
+// グリフ用の頂点（2D座標とテクスチャ座標を詰めたもの、16バイト）
+// ofMeshのvec3座標 + 別配列のvec2より小さく、1つのバッファにまとめて転送できる
+// テクスチャ座標はfloatのまま（ofVboのテクスチャ座標はGL_FLOAT固定で、固定機能パイプラインでは
+// 整数の正規化もできない。TextBatchはアトラスの拡張時に座標を縮めるので、量子化すると誤差も溜まる）
+struct GlyphVertex {
+    float x, y;
+    float u, v;
+};
+
+// グリフのクアッドを貯めて描画するバッファ
+// 頂点は1本のバッファに詰め、インデックスは全クアッド共通のもの（0,1,2,2,3,0 + 4n）を
+// 全インスタンスで1つだけ作って共有する。clear()しても確保済みの領域は残るので、
+// 同じくらいの量の文字列を毎フレーム描く場合は確保が発生しない
+// 色は頂点ごとに持つこともできる（addQuadに色を渡した場合）
+class GlyphQuadBuffer {
+public:
+    GlyphQuadBuffer() = default;
+
+    // コピーではCPU側の頂点だけを複製し、GPUバッファは共有しない
+    GlyphQuadBuffer(const GlyphQuadBuffer& other);
+    GlyphQuadBuffer& operator=(const GlyphQuadBuffer& other);
+    GlyphQuadBuffer(GlyphQuadBuffer&& other) noexcept = default;
+    GlyphQuadBuffer& operator=(GlyphQuadBuffer&& other) noexcept = default;
+
+    void reserve(size_t quadCount);
+    void clear();
+
+    void addQuad(const GlyphQuad& quad);
+    void addQuad(const GlyphQuad& quad, const ofFloatColor& color);
+
+    size_t getQuadCount() const { return vertices.size() / 4; }
+    bool empty() const { return vertices.empty(); }
+
+    // 頂点を直接書き換えた場合はmarkDirty()を呼ぶ
+    std::vector<GlyphVertex>& getVertices() { return vertices; }
+    const std::vector<GlyphVertex>& getVertices() const { return vertices; }
+    const std::vector<ofFloatColor>& getColors() const { return colors; }
+    void markDirty() { dirty = true; }
+
+    // ofMeshに変換して追加（互換API用）
+    void appendToMesh(ofMesh& mesh) const;
+
+    // 変更があればGPUに転送して描画（テクスチャはバインド済みであること）
+    void draw() const;
+
+    // CPU側・GPU側で確保している頂点のバイト数
+    size_t getMemoryUsage() const;
+
+private:
+    std::vector<GlyphVertex> vertices;
+    std::vector<ofFloatColor> colors;  // 空なら色なし
+
+    mutable ofBufferObject vertexBuffer;
+    mutable ofBufferObject colorBuffer;
+    mutable ofVbo vbo;
+    mutable size_t vertexCapacity = 0;  // GPUバッファの頂点数
+    mutable size_t colorCapacity = 0;
+    mutable bool dirty = true;
+    mutable bool attributesSet = false;
+    mutable bool attributesHaveColors = false;
+
+    void pushVertices(const GlyphQuad& quad);
+    void upload() const;
+    void setAttributes(size_t firstVertex) const;
+
+    // 全バッファで共有するインデックス（quadCount個分以上を保証して返す）
+    static ofBufferObject& getSharedIndexBuffer(size_t quadCount);
+};
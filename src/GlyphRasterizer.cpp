@@ -0,0 +1,269 @@
+#include "GlyphRasterizer.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+using namespace std;
+
+// 26.6固定小数点から浮動小数点への変換
+static double int26p6_to_dbl(long p) {
+    return double(p) / 64.0;
+}
+
+// ===========================================================================
+// ラスタライズ（同期・非同期共通）
+// ===========================================================================
+
+// 1ビット（MONO）でレンダリングした時のピクセル範囲（FreeTypeと同じ丸め）
+// 画素の中心を含むように四捨五入し、幅が0になったら端数の大きい側に1ピクセル広げる
+static void roundMonoRange(FT_Pos cboxMin, FT_Pos cboxMax, FT_Pos& outMin, FT_Pos& outMax) {
+    outMin = (cboxMin + 31) >> 6;
+    outMax = (cboxMax + 32) >> 6;
+    if (outMin == outMax) {
+        if (((cboxMin + 31) & 63) - 31 + ((cboxMax + 32) & 63) - 32 < 0) {
+            outMin -= 1;
+        } else {
+            outMax += 1;
+        }
+    }
+}
+
+void GlyphRasterizer::setGlyphPropsFromSlot(FT_GlyphSlot slot, bool antialiased, LazyGlyphProps& props) {
+    int bitmapLeft = slot->bitmap_left;
+    int bitmapTop = slot->bitmap_top;
+    int bitmapWidth = slot->bitmap.width;
+    int bitmapRows = slot->bitmap.rows;
+
+    if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
+        FT_BBox cbox;
+        FT_Outline_Get_CBox(&slot->outline, &cbox);
+        FT_Pos xMin, yMin, xMax, yMax;  // ピクセル単位
+        if (antialiased) {
+            xMin = cbox.xMin >> 6;          // floor
+            yMin = cbox.yMin >> 6;
+            xMax = (cbox.xMax + 63) >> 6;   // ceil
+            yMax = (cbox.yMax + 63) >> 6;
+        } else {
+            roundMonoRange(cbox.xMin, cbox.xMax, xMin, xMax);
+            roundMonoRange(cbox.yMin, cbox.yMax, yMin, yMax);
+        }
+        bitmapLeft = int(xMin);
+        bitmapTop = int(yMax);
+        bitmapWidth = int(xMax - xMin);
+        bitmapRows = int(yMax - yMin);
+    }
+
+    // プロパティ設定（ofTrueTypeFontと同じ計算方法）
+    props.width = int26p6_to_dbl(slot->metrics.width);
+    props.height = int26p6_to_dbl(slot->metrics.height);
+    props.bearingX = int26p6_to_dbl(slot->metrics.horiBearingX);
+    props.bearingY = int26p6_to_dbl(slot->metrics.horiBearingY);
+    props.advance = int26p6_to_dbl(slot->metrics.horiAdvance);
+    // xmin/ymin/xmax/ymaxはbitmap_left/bitmap_topから計算（重要！）
+    props.xmin = bitmapLeft;
+    props.xmax = props.xmin + props.width;
+    props.ymin = -bitmapTop;  // マイナスが重要
+    props.ymax = props.ymin + props.height;
+    props.tW = bitmapWidth;
+    props.tH = bitmapRows;
+}
+
+void GlyphRasterizer::renderLoadedGlyph(FT_GlyphSlot slot, bool antialiased, ofPixelFormat format,
+                                        ofPixels& outPixels, LazyGlyphProps& outProps) {
+    // ラスタライズ
+    if (antialiased) {
+        FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
+    } else {
+        FT_Render_Glyph(slot, FT_RENDER_MODE_MONO);
+    }
+
+    FT_Bitmap& bitmap = slot->bitmap;
+    int width = bitmap.width;
+    int height = bitmap.rows;
+    setGlyphPropsFromSlot(slot, antialiased, outProps);  // レンダリング後なので実際のビットマップの値
+
+    if (width == 0 || height == 0) {
+        // スペースなど描画不要な文字
+        outPixels.clear();
+        return;
+    }
+
+    // ピクセルデータを作成（アトラスと同じフォーマット）
+    outPixels.allocate(width, height, format);
+    if (format == OF_PIXELS_GRAY) {
+        outPixels.set(0, 0);    // カバレッジ = 0
+    } else {
+        outPixels.set(0, 255);  // ルミナンス = 白
+        outPixels.set(1, 0);    // アルファ = 透明
+    }
+
+    // カバレッジは最後のチャンネル（GRAY_ALPHAならアルファ、GRAYならそのもの）
+    size_t channels = outPixels.getNumChannels();
+    unsigned char* dst = outPixels.getData() + channels - 1;
+
+    if (antialiased) {
+        // グレースケール
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                dst[(size_t(y) * width + x) * channels] = bitmap.buffer[y * bitmap.pitch + x];
+            }
+        }
+    } else {
+        // モノクロ（1ビット）
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int byteIndex = x / 8;
+                int bitIndex = 7 - (x % 8);
+                unsigned char byte = bitmap.buffer[y * bitmap.pitch + byteIndex];
+                dst[(size_t(y) * width + x) * channels] = (byte & (1 << bitIndex)) ? 255 : 0;
+            }
+        }
+    }
+}
+
+// ===========================================================================
+// ワーカープール
+// ===========================================================================
+
+GlyphRasterizer::~GlyphRasterizer() {
+    stop();
+}
+
+bool GlyphRasterizer::start(const of::filesystem::path& fontPath, int fontSize, int dpi, bool antialias,
+                            ofPixelFormat pixelFormat, size_t threadCount) {
+    stop();
+
+    antialiased = antialias;
+    format = pixelFormat;
+    if (threadCount == 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        threadCount = cores > 1 ? cores - 1 : 1;
+    }
+
+    // フェイスはここで開いておき、以降はそのワーカーだけが使う
+    string path = fontPath.string();
+    for (size_t i = 0; i < threadCount; i++) {
+        auto worker = make_unique<Worker>();
+        if (FT_Init_FreeType(&worker->library)) {
+            ofLogError("GlyphRasterizer") << "Failed to initialize FreeType library";
+            break;
+        }
+        if (FT_New_Face(worker->library, path.c_str(), 0, &worker->face)) {
+            ofLogError("GlyphRasterizer") << "Failed to load font: " << path;
+            FT_Done_FreeType(worker->library);
+            break;
+        }
+        FT_Set_Char_Size(worker->face, fontSize << 6, fontSize << 6, dpi, dpi);
+        workers.push_back(std::move(worker));
+    }
+    if (workers.size() < threadCount) {
+        for (auto& worker : workers) {
+            FT_Done_Face(worker->face);
+            FT_Done_FreeType(worker->library);
+        }
+        workers.clear();
+        return false;
+    }
+
+    stopping = false;
+    for (auto& worker : workers) {
+        Worker* w = worker.get();
+        w->thread = std::thread([this, w] { workerLoop(*w); });
+    }
+    ofLogVerbose("GlyphRasterizer") << "Started " << workers.size() << " rasterizer thread(s)";
+    return true;
+}
+
+void GlyphRasterizer::stop() {
+    if (workers.empty()) return;
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        requests.clear();
+    }
+    requestReady.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+        FT_Done_Face(worker->face);
+        FT_Done_FreeType(worker->library);
+    }
+    workers.clear();
+
+    lock_guard<std::mutex> lock(mutex);
+    results.clear();
+    inFlight = 0;
+}
+
+void GlyphRasterizer::request(uint32_t codepoint) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        requests.push_back(codepoint);
+    }
+    requestReady.notify_one();
+}
+
+void GlyphRasterizer::request(const vector<uint32_t>& codepoints) {
+    if (codepoints.empty()) return;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        requests.insert(requests.end(), codepoints.begin(), codepoints.end());
+    }
+    requestReady.notify_all();
+}
+
+size_t GlyphRasterizer::collect(vector<RasterizedGlyph>& out, size_t maxCount) {
+    lock_guard<std::mutex> lock(mutex);
+    size_t count = (maxCount == 0) ? results.size() : min(maxCount, results.size());
+    if (count == 0) return 0;
+
+    // 古いものから取り出す
+    out.insert(out.end(), make_move_iterator(results.begin()), make_move_iterator(results.begin() + count));
+    results.erase(results.begin(), results.begin() + count);
+    return count;
+}
+
+size_t GlyphRasterizer::getPendingCount() const {
+    lock_guard<std::mutex> lock(mutex);
+    return requests.size() + inFlight + results.size();
+}
+
+void GlyphRasterizer::waitUntilIdle() {
+    unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return (requests.empty() && inFlight == 0) || stopping; });
+}
+
+void GlyphRasterizer::workerLoop(Worker& worker) {
+    while (true) {
+        uint32_t codepoint;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            requestReady.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping) return;
+            codepoint = requests.front();
+            requests.pop_front();
+            inFlight++;
+        }
+
+        RasterizedGlyph result;
+        result.codepoint = codepoint;
+        FT_UInt glyphIndex = FT_Get_Char_Index(worker.face, codepoint);
+        if (glyphIndex != 0 && FT_Load_Glyph(worker.face, glyphIndex, FT_LOAD_NO_HINTING) == 0) {
+            result.props = LazyGlyphProps();
+            result.props.glyphIndex = glyphIndex;
+            renderLoadedGlyph(worker.face->glyph, antialiased, format, result.pixels, result.props);
+            result.found = true;
+        }
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(result));
+            inFlight--;
+            if (requests.empty() && inFlight == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ofxTrueTypeFontLowRAM.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// ラスタライズ済みのグリフ（ワーカースレッドからの結果）
+struct RasterizedGlyph {
+    uint32_t codepoint = 0;
+    bool found = false;     // フォントに存在し、ラスタライズできたか
+    LazyGlyphProps props;   // アトラス上の位置以外
+    ofPixels pixels;        // アトラスと同じフォーマット（空ならスペースなど）
+};
+
+// バックグラウンドでグリフをラスタライズするワーカープール
+// FT_Faceはスレッドセーフではないので、ワーカーごとにFT_LibraryとFT_Faceを持つ
+// 結果はcollect()で受け取り、アトラスへの配置と転送は呼び出し側（GLスレッド）で行う
+class GlyphRasterizer {
+public:
+    GlyphRasterizer() = default;
+    ~GlyphRasterizer();
+
+    GlyphRasterizer(const GlyphRasterizer&) = delete;
+    GlyphRasterizer& operator=(const GlyphRasterizer&) = delete;
+
+    // ワーカーを起動（threadCountが0ならコア数-1、最低1）
+    bool start(const of::filesystem::path& fontPath, int fontSize, int dpi, bool antialiased,
+               ofPixelFormat format, size_t threadCount = 0);
+    void stop();
+
+    bool isRunning() const { return !workers.empty(); }
+    size_t getThreadCount() const { return workers.size(); }
+
+    // ラスタライズを依頼（重複の確認は呼び出し側で行う）
+    void request(uint32_t codepoint);
+    void request(const vector<uint32_t>& codepoints);
+
+    // 終わった結果を最大maxCount個取り出す（0なら全部）
+    size_t collect(vector<RasterizedGlyph>& out, size_t maxCount = 0);
+
+    // 依頼済みで、まだ取り出されていない数
+    size_t getPendingCount() const;
+
+    // 全ての依頼が終わるまで待つ
+    void waitUntilIdle();
+
+    // FT_Load_Glyph済みのスロットからグリフ情報を設定
+    // ラスタライズ前ならアウトラインの外接矩形から、レンダリング後と同じピクセル範囲を求める
+    // （丸め方はレンダリングモードで違うので、antialiasedはレンダリング時と同じにする）
+    static void setGlyphPropsFromSlot(struct FT_GlyphSlotRec_* slot, bool antialiased, LazyGlyphProps& props);
+
+    // FT_Load_Glyph済みのスロットをレンダリングして、指定フォーマットのピクセルにする
+    // （同期ロードとワーカーで共通）
+    static void renderLoadedGlyph(struct FT_GlyphSlotRec_* slot, bool antialiased, ofPixelFormat format,
+                                  ofPixels& outPixels, LazyGlyphProps& outProps);
+
+private:
+    struct Worker {
+        struct FT_LibraryRec_* library = nullptr;
+        struct FT_FaceRec_* face = nullptr;
+        std::thread thread;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    bool antialiased = true;
+    ofPixelFormat format = OF_PIXELS_GRAY_ALPHA;
+
+    mutable std::mutex mutex;
+    std::condition_variable requestReady;
+    std::condition_variable idle;
+    std::deque<uint32_t> requests;
+    vector<RasterizedGlyph> results;
+    size_t inFlight = 0;   // ワーカーが処理中の数
+    bool stopping = false;
+
+    void workerLoop(Worker& worker);
+};
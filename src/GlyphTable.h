@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// コードポイント → グリフ情報の表
+// ASCIIは配列に直接、BMP（U+0000〜U+FFFF）は256文字単位のページ表で引き、
+// ハッシュを使うのはそれ以外（絵文字など）だけにする
+// 要素のアドレスは削除されるまで変わらない（ポインタを保持してよい）
+template<typename T>
+class GlyphTable {
+public:
+    GlyphTable() {
+        asciiUsed.fill(false);
+    }
+
+    T* find(uint32_t codepoint) {
+        return const_cast<T*>(static_cast<const GlyphTable*>(this)->find(codepoint));
+    }
+
+    const T* find(uint32_t codepoint) const {
+        if (codepoint < asciiSize) {
+            return asciiUsed[codepoint] ? &ascii[codepoint] : nullptr;
+        }
+        if (codepoint < bmpSize) {
+            const Page* page = pages[codepoint >> pageBits].get();
+            if (!page) return nullptr;
+            uint32_t slot = page->slots[codepoint & pageMask];
+            return slot ? &entryAt(slot - 1).value : nullptr;
+        }
+        auto it = astral.find(codepoint);
+        return it != astral.end() ? &it->second : nullptr;
+    }
+
+    // 追加（既にあれば上書き）
+    T& insert(uint32_t codepoint, const T& value) {
+        count++;
+        if (codepoint < asciiSize) {
+            if (asciiUsed[codepoint]) count--;
+            asciiUsed[codepoint] = true;
+            ascii[codepoint] = value;
+            return ascii[codepoint];
+        }
+        if (codepoint < bmpSize) {
+            auto& page = pages[codepoint >> pageBits];
+            if (!page) page = std::make_unique<Page>();
+            uint32_t& slot = page->slots[codepoint & pageMask];
+            if (slot) {
+                count--;
+            } else {
+                slot = allocateEntry() + 1;
+            }
+            Entry& entry = entryAt(slot - 1);
+            entry.codepoint = codepoint;
+            entry.value = value;
+            return entry.value;
+        }
+        auto result = astral.insert_or_assign(codepoint, value);
+        if (!result.second) count--;
+        return result.first->second;
+    }
+
+    bool erase(uint32_t codepoint) {
+        if (codepoint < asciiSize) {
+            if (!asciiUsed[codepoint]) return false;
+            asciiUsed[codepoint] = false;
+        } else if (codepoint < bmpSize) {
+            Page* page = pages[codepoint >> pageBits].get();
+            if (!page || !page->slots[codepoint & pageMask]) return false;
+            uint32_t index = page->slots[codepoint & pageMask] - 1;
+            page->slots[codepoint & pageMask] = 0;
+            entryAt(index).codepoint = invalidCodepoint;
+            freeEntries.push_back(index);
+        } else if (astral.erase(codepoint) == 0) {
+            return false;
+        }
+        count--;
+        return true;
+    }
+
+    // 全要素を f(codepoint, value) で走査（走査中の追加・削除は不可）
+    template<typename F>
+    void forEach(F&& f) {
+        for (uint32_t c = 0; c < asciiSize; c++) {
+            if (asciiUsed[c]) f(c, ascii[c]);
+        }
+        for (size_t i = 0; i < entryCount; i++) {
+            Entry& entry = entryAt(i);
+            if (entry.codepoint != invalidCodepoint) f(entry.codepoint, entry.value);
+        }
+        for (auto& [c, value] : astral) {
+            f(c, value);
+        }
+    }
+
+    template<typename F>
+    void forEach(F&& f) const {
+        const_cast<GlyphTable*>(this)->forEach([&f](uint32_t c, const T& value) { f(c, value); });
+    }
+
+    size_t size() const { return count; }
+
+    void clear() {
+        asciiUsed.fill(false);
+        for (auto& page : pages) page.reset();
+        chunks.clear();
+        freeEntries.clear();
+        entryCount = 0;
+        astral.clear();
+        count = 0;
+    }
+
+    // 表そのものが使っているメモリ（おおよそ）
+    size_t getMemoryUsage() const {
+        size_t total = sizeof(*this);
+        for (const auto& page : pages) {
+            if (page) total += sizeof(Page);
+        }
+        total += chunks.size() * (sizeof(Entry) * chunkSize);
+        total += freeEntries.capacity() * sizeof(uint32_t);
+        total += astral.size() * (sizeof(uint32_t) + sizeof(T) + 2 * sizeof(void*));
+        return total;
+    }
+
+private:
+    static constexpr uint32_t asciiSize = 128;
+    static constexpr uint32_t bmpSize = 0x10000;
+    static constexpr uint32_t pageBits = 8;
+    static constexpr uint32_t pageMask = (1u << pageBits) - 1;
+    static constexpr uint32_t chunkBits = 8;
+    static constexpr uint32_t chunkSize = 1u << chunkBits;
+    static constexpr uint32_t invalidCodepoint = 0xFFFFFFFF;
+
+    // ASCII: 直接引ける配列
+    std::array<T, asciiSize> ascii;
+    std::array<bool, asciiSize> asciiUsed;
+
+    // BMP: ページ表（スロット番号+1、0なら空）と、チャンク単位の実体
+    // 実体をページに直接持たないのは、漢字のようにまばらに使われる範囲でメモリを無駄にしないため
+    struct Page {
+        uint32_t slots[1u << pageBits] = {};
+    };
+    struct Entry {
+        uint32_t codepoint = invalidCodepoint;
+        T value;
+    };
+    std::array<std::unique_ptr<Page>, (bmpSize >> pageBits)> pages;
+    std::vector<std::unique_ptr<Entry[]>> chunks;
+    std::vector<uint32_t> freeEntries;
+    size_t entryCount = 0;
+
+    // それ以外（アストラル面）
+    std::unordered_map<uint32_t, T> astral;
+
+    size_t count = 0;
+
+    Entry& entryAt(size_t index) {
+        return chunks[index >> chunkBits][index & (chunkSize - 1)];
+    }
+
+    const Entry& entryAt(size_t index) const {
+        return chunks[index >> chunkBits][index & (chunkSize - 1)];
+    }
+
+    uint32_t allocateEntry() {
+        if (!freeEntries.empty()) {
+            uint32_t index = freeEntries.back();
+            freeEntries.pop_back();
+            return index;
+        }
+        if ((entryCount >> chunkBits) >= chunks.size()) {
+            chunks.emplace_back(new Entry[chunkSize]);
+        }
+        return uint32_t(entryCount++);
+    }
+};
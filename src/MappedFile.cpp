@@ -0,0 +1,112 @@
+#include "MappedFile.h"
+#include "ofLog.h"
+
+#include <vector>
+
+#ifdef TARGET_WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const of::filesystem::path& path) {
+    close();
+
+#ifdef TARGET_WIN32
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        ofLogError("MappedFile") << "Failed to open: " << path;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        ofLogError("MappedFile") << "Failed to get size: " << path;
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        ofLogError("MappedFile") << "Failed to map: " << path;
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = view;
+    mappedSize = size_t(fileSize.QuadPart);
+#else
+    int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+        ofLogError("MappedFile") << "Failed to open: " << path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        ofLogError("MappedFile") << "Failed to get size: " << path;
+        return false;
+    }
+    void* view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // マップはファイルを閉じても残る
+    if (view == MAP_FAILED) {
+        ofLogError("MappedFile") << "Failed to map: " << path;
+        return false;
+    }
+    // フォントのテーブルは飛び飛びに読まれるので先読みしない（読んだページだけを常駐させる）
+    madvise(view, size_t(st.st_size), MADV_RANDOM);
+    mappedData = view;
+    mappedSize = size_t(st.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!mappedData) return;
+#ifdef TARGET_WIN32
+    UnmapViewOfFile(mappedData);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(mappedData, mappedSize);
+#endif
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+size_t MappedFile::getResidentBytes() const {
+    if (!mappedData) return 0;
+#ifdef TARGET_WIN32
+    // 常駐ページ数の取得は省略（上限としてマップした全体を返す）
+    return mappedSize;
+#else
+    size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    size_t pageCount = (mappedSize + pageSize - 1) / pageSize;
+#ifdef TARGET_OSX
+    vector<char> residency(pageCount);
+#else
+    vector<unsigned char> residency(pageCount);
+#endif
+    if (mincore(mappedData, mappedSize, residency.data()) != 0) {
+        return mappedSize;
+    }
+    size_t residentPages = 0;
+    for (auto page : residency) {
+        if (page & 1) residentPages++;
+    }
+    return min(residentPages * pageSize, mappedSize);
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ofConstants.h"
+#include <cstddef>
+#include <cstdint>
+
+// 読み取り専用でメモリマップしたファイル
+// ページはOSのページキャッシュと共有され、他のプロセスが同じファイルをマップしていれば物理メモリも共有される
+// 実際に読んだページだけが常駐する
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const of::filesystem::path& path);
+    void close();
+
+    bool isOpen() const { return mappedData != nullptr; }
+    const uint8_t* data() const { return static_cast<const uint8_t*>(mappedData); }
+    size_t size() const { return mappedSize; }
+
+    // マップした範囲のうち、物理メモリに常駐しているバイト数
+    // （取得できない環境ではマップした全体を返す）
+    size_t getResidentBytes() const;
+
+private:
+    void* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef TARGET_WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,261 @@
+#include "SharedGlyphStore.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifndef TARGET_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// プロセス間で共有するのでアドレスに依存しない（ロックフリーな）atomicであること
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared store needs lock-free 32-bit atomics");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared store needs lock-free 64-bit atomics");
+
+static const char sharedStoreMagic[8] = {'O', 'F', 'X', 'T', 'T', 'F', 'S', 'G'};
+static const uint32_t sharedStoreVersion = 1;
+
+// 初期化の状態（作成直後のファイルは0で埋まっている）
+enum : uint32_t {
+    storeUninitialized = 0,
+    storeInitializing = 1,
+    storeReady = 2,
+};
+
+struct SharedGlyphStore::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t propsSize;
+    uint64_t fontHash;
+    int32_t fontSize;
+    int32_t dpi;
+    uint32_t antialiased;
+    uint32_t singleChannel;
+    uint32_t slotCount;     // 2の累乗
+    uint32_t reserved;
+    uint64_t slotsOffset;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    std::atomic<uint32_t> initState;
+    std::atomic<uint32_t> glyphCount;
+    std::atomic<uint64_t> dataUsed;
+};
+
+struct SharedGlyphStore::Slot {
+    std::atomic<uint32_t> key;    // 文字 + 1（0なら空き）
+    std::atomic<uint32_t> ready;  // 書き終わったら1
+    int32_t width;
+    int32_t height;
+    uint64_t pixelOffset;         // ビットマップ領域の先頭からの位置
+    LazyGlyphProps props;
+};
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t slotHash(uint32_t codepoint) {
+    return codepoint * 2654435761u;
+}
+
+SharedGlyphStore::~SharedGlyphStore() {
+    close();
+}
+
+bool SharedGlyphStore::open(const of::filesystem::path& path, const Key& key, size_t sizeBytes) {
+    close();
+
+#ifdef TARGET_WIN32
+    ofLogWarning("SharedGlyphStore") << "Shared glyph store is not supported on Windows";
+    return false;
+#else
+    error_code ec;
+    of::filesystem::create_directories(path.parent_path(), ec);
+
+    // グリフの中身が読めるので、作成したユーザー以外には開かせない
+    int fd = ::open(path.string().c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        ofLogError("SharedGlyphStore") << "Failed to open: " << path;
+        return false;
+    }
+
+    // 新しいファイルなら大きさを決める（同時に作られても同じ大きさに揃うだけ）
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        if (ftruncate(fd, off_t(sizeBytes)) != 0) {
+            ::close(fd);
+            ofLogError("SharedGlyphStore") << "Failed to resize: " << path;
+            return false;
+        }
+    }
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header) + sizeof(Slot) * 1024) {
+        ::close(fd);
+        ofLogError("SharedGlyphStore") << "Invalid store file: " << path;
+        return false;
+    }
+
+    size_t size = size_t(st.st_size);
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        ofLogError("SharedGlyphStore") << "Failed to map: " << path;
+        return false;
+    }
+    mappedData = view;
+    mappedSize = size;
+
+    Header* h = static_cast<Header*>(view);
+    bool singleChannel = (key.format == OF_PIXELS_GRAY);
+
+    // 最初に開いたプロセスが初期化する
+    uint32_t state = storeUninitialized;
+    if (h->initState.compare_exchange_strong(state, storeInitializing, memory_order_acq_rel)) {
+        // スロット表はファイルの1/16程度（1024〜65536個）
+        uint32_t slotCount = 1024;
+        while (slotCount < 65536 && size_t(slotCount) * 2 * sizeof(Slot) <= size / 16) {
+            slotCount *= 2;
+        }
+        memcpy(h->magic, sharedStoreMagic, sizeof(sharedStoreMagic));
+        h->version = sharedStoreVersion;
+        h->propsSize = sizeof(LazyGlyphProps);
+        h->fontHash = key.fontHash;
+        h->fontSize = key.fontSize;
+        h->dpi = key.dpi;
+        h->antialiased = key.antialiased;
+        h->singleChannel = singleChannel;
+        h->slotCount = slotCount;
+        h->slotsOffset = alignUp(sizeof(Header), 64);
+        h->dataOffset = alignUp(h->slotsOffset + sizeof(Slot) * slotCount, 64);
+        h->dataSize = size > h->dataOffset ? size - h->dataOffset : 0;
+        h->initState.store(storeReady, memory_order_release);
+    } else {
+        // 他のプロセスが初期化中なら少し待つ（1秒で諦める）
+        for (int i = 0; i < 1000 && h->initState.load(memory_order_acquire) != storeReady; i++) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if (h->initState.load(memory_order_acquire) != storeReady) {
+            ofLogError("SharedGlyphStore") << "Store was not initialized by its creator: " << path;
+            close();
+            return false;
+        }
+    }
+
+    if (memcmp(h->magic, sharedStoreMagic, sizeof(sharedStoreMagic)) != 0 || h->version != sharedStoreVersion ||
+        h->propsSize != sizeof(LazyGlyphProps) || h->fontHash != key.fontHash || h->fontSize != key.fontSize ||
+        h->dpi != key.dpi || bool(h->antialiased) != key.antialiased || bool(h->singleChannel) != singleChannel ||
+        h->dataOffset + h->dataSize > size || h->slotsOffset + sizeof(Slot) * h->slotCount > h->dataOffset) {
+        ofLogError("SharedGlyphStore") << "Store does not match this font: " << path;
+        close();
+        return false;
+    }
+
+    header = h;
+    slots = reinterpret_cast<Slot*>(static_cast<uint8_t*>(view) + h->slotsOffset);
+    pixelData = static_cast<uint8_t*>(view) + h->dataOffset;
+    format = key.format;
+    bytesPerPixel = singleChannel ? 1 : 2;
+    return true;
+#endif
+}
+
+void SharedGlyphStore::close() {
+#ifndef TARGET_WIN32
+    if (mappedData) {
+        munmap(mappedData, mappedSize);
+    }
+#endif
+    mappedData = nullptr;
+    mappedSize = 0;
+    header = nullptr;
+    slots = nullptr;
+    pixelData = nullptr;
+}
+
+bool SharedGlyphStore::find(uint32_t codepoint, LazyGlyphProps& outProps, ofPixels& outPixels) const {
+    if (!header) return false;
+
+    uint32_t mask = header->slotCount - 1;
+    uint32_t wanted = codepoint + 1;
+    for (uint32_t i = 0, index = slotHash(codepoint) & mask; i <= mask; i++, index = (index + 1) & mask) {
+        const Slot& slot = slots[index];
+        uint32_t key = slot.key.load(memory_order_acquire);
+        if (key == 0) return false;
+        if (key != wanted) continue;
+
+        // 書き込み中（または書き込んだプロセスが途中で落ちた）
+        if (slot.ready.load(memory_order_acquire) == 0) return false;
+
+        // 壊れた（他のプロセスが書き換えた）ファイルでも領域の外は読まない
+        if (slot.width > 0 && slot.height > 0) {
+            uint64_t bytes = uint64_t(slot.width) * uint64_t(slot.height) * bytesPerPixel;
+            if (slot.pixelOffset > header->dataSize || bytes > header->dataSize - slot.pixelOffset) return false;
+        }
+
+        outProps = slot.props;
+        if (slot.width > 0 && slot.height > 0) {
+            outPixels.setFromPixels(pixelData + slot.pixelOffset, slot.width, slot.height, format);
+        } else {
+            outPixels.clear();
+        }
+        return true;
+    }
+    return false;
+}
+
+bool SharedGlyphStore::publish(uint32_t codepoint, const LazyGlyphProps& props, const ofPixels& pixels) {
+    if (!header) return false;
+
+    int width = pixels.isAllocated() ? int(pixels.getWidth()) : 0;
+    int height = pixels.isAllocated() ? int(pixels.getHeight()) : 0;
+    if (width > 0 && pixels.getNumChannels() != bytesPerPixel) return false;
+
+    size_t bytes = alignUp(size_t(width) * height * bytesPerPixel, 8);
+    uint32_t mask = header->slotCount - 1;
+    uint32_t wanted = codepoint + 1;
+    for (uint32_t i = 0, index = slotHash(codepoint) & mask; i <= mask; i++, index = (index + 1) & mask) {
+        Slot& slot = slots[index];
+        uint32_t key = 0;
+        if (!slot.key.compare_exchange_strong(key, wanted, memory_order_acq_rel)) {
+            if (key == wanted) return false;  // 他のプロセスが先に書いた
+            continue;
+        }
+
+        // スロットを確保できてからビットマップの領域を確保する
+        // 満杯なら使用量は進めず、スロットはreadyを立てないまま残す（どのプロセスも各自でラスタライズする）
+        uint64_t offset = 0;
+        if (bytes > 0) {
+            offset = header->dataUsed.load(memory_order_relaxed);
+            do {
+                if (offset > header->dataSize || bytes > header->dataSize - offset) return false;
+            } while (!header->dataUsed.compare_exchange_weak(offset, offset + bytes, memory_order_relaxed));
+        }
+
+        slot.width = width;
+        slot.height = height;
+        slot.pixelOffset = offset;
+        slot.props = props;
+        slot.props.hasBitmap = false;
+        slot.props.lastUsedFrame = 0;
+        if (bytes > 0) {
+            memcpy(pixelData + offset, pixels.getData(), size_t(width) * height * bytesPerPixel);
+        }
+        slot.ready.store(1, memory_order_release);
+        header->glyphCount.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+    return false;  // スロット表が満杯
+}
+
+size_t SharedGlyphStore::getGlyphCount() const {
+    return header ? header->glyphCount.load(memory_order_relaxed) : 0;
+}
+
+size_t SharedGlyphStore::getUsedBytes() const {
+    return header ? header->dataUsed.load(memory_order_relaxed) : 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ofxTrueTypeFontLowRAM.h"
+
+// ラスタライズ済みグリフを複数プロセスで共有するストア
+// 読み書き可能でMAP_SHAREDにmmapしたファイル（Linuxなら/dev/shm上に置けば共有メモリ）に、
+// グリフ情報とビットマップを書き込む。同じフォント・サイズを使う他のプロセスは、
+// ラスタライズせずにここからコピーして自分のアトラス（GPUテクスチャ）に配置する
+//
+// ロックは使わない:
+//   - グリフ表はオープンアドレスのハッシュ表で、キーのCASでスロットを確保し、
+//     書き終わったらreadyを立てる（readyが立つまで読む側は「ない」ものとして扱う）
+//   - ビットマップ領域はスロットを確保できてから、先頭から詰めて確保する（CASで末尾を超えない分だけ進める）
+// 削除はしない。満杯になったら以降は書き込まない（読むだけ）
+class SharedGlyphStore {
+public:
+    // ストアのキー（一致しないファイルは使わない）
+    struct Key {
+        uint64_t fontHash = 0;
+        int32_t fontSize = 0;
+        int32_t dpi = 0;
+        bool antialiased = true;
+        ofPixelFormat format = OF_PIXELS_GRAY_ALPHA;
+    };
+
+    SharedGlyphStore() = default;
+    ~SharedGlyphStore();
+
+    SharedGlyphStore(const SharedGlyphStore&) = delete;
+    SharedGlyphStore& operator=(const SharedGlyphStore&) = delete;
+
+    // ファイルを開く（なければsizeBytesで作成して初期化する）
+    bool open(const of::filesystem::path& path, const Key& key, size_t sizeBytes);
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+
+    // グリフを探してコピーする（なければ・書き込み中ならfalse）
+    bool find(uint32_t codepoint, LazyGlyphProps& outProps, ofPixels& outPixels) const;
+
+    // グリフを書き込む（既にある・満杯ならfalse）
+    // propsのアトラス上の位置は書き込まれても意味を持たない（各プロセスで配置し直す）
+    bool publish(uint32_t codepoint, const LazyGlyphProps& props, const ofPixels& pixels);
+
+    // 書き込まれているグリフ数とビットマップ領域の使用量
+    size_t getGlyphCount() const;
+    size_t getUsedBytes() const;
+    size_t getMappedBytes() const { return mappedSize; }
+
+private:
+    struct Header;
+    struct Slot;
+
+    Header* header = nullptr;
+    Slot* slots = nullptr;
+    uint8_t* pixelData = nullptr;
+    void* mappedData = nullptr;
+    size_t mappedSize = 0;
+    size_t bytesPerPixel = 2;
+    ofPixelFormat format = OF_PIXELS_GRAY_ALPHA;
+};
@@ -0,0 +1,179 @@
+#include "TextBatch.h"
+#include "ofxTrueTypeFontLowRAM.h"
+#include "ofGLUtils.h"
+
+using namespace std;
+
+// ===========================================================================
+// ScopedTextBlend
+// ===========================================================================
+
+ScopedTextBlend::ScopedTextBlend() {
+    blendEnabled = glIsEnabled(GL_BLEND);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrcRGB);
+    glGetIntegerv(GL_BLEND_DST_RGB, &blendDstRGB);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendSrcAlpha);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &blendDstAlpha);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+ScopedTextBlend::~ScopedTextBlend() {
+    if (!blendEnabled) {
+        glDisable(GL_BLEND);
+    }
+    glBlendFuncSeparate(blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha);
+}
+
+// ===========================================================================
+// TextBatch
+// ===========================================================================
+
+TextBatch::TextBatch() : transform(1.0f) {
+}
+
+TextBatch::Group& TextBatch::getGroup(FontAtlasManager* manager, size_t atlasIndex) {
+    // 同じアトラスへの追加が続くことが多いので、直前のグループを先に見る
+    if (lastGroup < groups.size()) {
+        Group& last = groups[lastGroup];
+        if (last.manager == manager && last.atlasIndex == atlasIndex &&
+            last.atlasReleaseCount == manager->getAtlasReleaseCount()) {
+            return last;
+        }
+    }
+
+    size_t freeGroup = SIZE_MAX;
+    for (size_t i = 0; i < groups.size(); i++) {
+        if (groups[i].manager == manager && groups[i].atlasIndex == atlasIndex &&
+            groups[i].atlasReleaseCount == manager->getAtlasReleaseCount()) {
+            lastGroup = i;
+            return groups[i];
+        }
+        if (!groups[i].manager && freeGroup == SIZE_MAX) {
+            freeGroup = i;
+        }
+    }
+
+    if (freeGroup == SIZE_MAX) {
+        freeGroup = groups.size();
+        groups.emplace_back();
+    }
+
+    Group& group = groups[freeGroup];
+    group.manager = manager;
+    group.atlasIndex = atlasIndex;
+    group.atlasWidth = manager->getAtlasWidth(atlasIndex);
+    group.atlasHeight = manager->getAtlasHeight(atlasIndex);
+    group.atlasReleaseCount = manager->getAtlasReleaseCount();
+    lastGroup = freeGroup;
+    return group;
+}
+
+void TextBatch::addQuad(FontAtlasManager* manager, size_t atlasIndex, const GlyphQuad& quad, const ofFloatColor& color) {
+    Group& group = getGroup(manager, atlasIndex);
+
+    // 前のクアッドを追加した後にアトラスが拡張されていたら、先に座標を合わせる
+    syncAtlasSize(group);
+
+    if (hasTransform) {
+        // 変換後の4隅から、回転にも対応できるよう頂点を個別に求める
+        glm::vec3 corners[4] = {
+            glm::vec3(transform * glm::vec4(quad.x0, quad.y0, 0.f, 1.f)),
+            glm::vec3(transform * glm::vec4(quad.x1, quad.y0, 0.f, 1.f)),
+            glm::vec3(transform * glm::vec4(quad.x1, quad.y1, 0.f, 1.f)),
+            glm::vec3(transform * glm::vec4(quad.x0, quad.y1, 0.f, 1.f)),
+        };
+        group.quads.addQuad(quad, color);
+        auto& vertices = group.quads.getVertices();
+        GlyphVertex* added = &vertices[vertices.size() - 4];
+        for (int i = 0; i < 4; i++) {
+            added[i].x = corners[i].x;
+            added[i].y = corners[i].y;
+        }
+    } else {
+        group.quads.addQuad(quad, color);
+    }
+
+    quadCount++;
+}
+
+void TextBatch::setTransform(const glm::mat4& m) {
+    transform = m;
+    hasTransform = (m != glm::mat4(1.0f));
+}
+
+void TextBatch::resetTransform() {
+    transform = glm::mat4(1.0f);
+    hasTransform = false;
+}
+
+void TextBatch::clear() {
+    for (auto& group : groups) {
+        group.manager = nullptr;
+        group.quads.clear();
+    }
+    lastGroup = 0;
+    quadCount = 0;
+    resetTransform();
+}
+
+void TextBatch::syncAtlasSize(Group& group) {
+    FontAtlasManager& manager = *group.manager;
+    if (group.atlasReleaseCount != manager.getAtlasReleaseCount()) return;
+
+    // 拡張では既存グリフのピクセル位置は変わらないので、テクスチャ座標の比率を変えるだけでよい
+    int newW = manager.getAtlasWidth(group.atlasIndex);
+    int newH = manager.getAtlasHeight(group.atlasIndex);
+    if (newW == group.atlasWidth && newH == group.atlasHeight) return;
+
+    float scaleU = float(group.atlasWidth) / newW;
+    float scaleV = float(group.atlasHeight) / newH;
+    for (auto& vertex : group.quads.getVertices()) {
+        vertex.u *= scaleU;
+        vertex.v *= scaleV;
+    }
+    group.quads.markDirty();
+    group.atlasWidth = newW;
+    group.atlasHeight = newH;
+}
+
+void TextBatch::syncAtlasSizes() {
+    for (auto& group : groups) {
+        if (group.manager) syncAtlasSize(group);
+    }
+}
+
+void TextBatch::draw() {
+    if (quadCount == 0) return;
+
+    syncAtlasSizes();
+
+    // 未転送のグリフはアトラス管理ごとに1回だけ転送する
+    vector<FontAtlasManager*> flushed;
+    for (auto& group : groups) {
+        if (!group.manager || group.quads.empty()) continue;
+        if (find(flushed.begin(), flushed.end(), group.manager) == flushed.end()) {
+            group.manager->flushUploads();
+            flushed.push_back(group.manager);
+        }
+    }
+
+    ScopedTextBlend blend;
+
+    for (auto& group : groups) {
+        if (!group.manager || group.quads.empty()) continue;
+
+        // 組み立て中にアトラスが解放されると番号がずれるので描画しない
+        if (group.atlasReleaseCount != group.manager->getAtlasReleaseCount()) {
+            ofLogWarning("TextBatch") << "draw(): atlas was released while batching, skipped "
+                                      << group.quads.getQuadCount() << " glyphs";
+            continue;
+        }
+
+        const ofTexture& texture = group.manager->getTexture(group.atlasIndex);
+        texture.bind();
+        group.quads.draw();
+        texture.unbind();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "GlyphQuadBuffer.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class FontAtlasManager;
+
+// テキスト描画用のブレンド設定
+// 生成時に現在の設定を保存してアルファブレンドに切り替え、破棄時に元に戻す
+class ScopedTextBlend {
+public:
+    ScopedTextBlend();
+    ~ScopedTextBlend();
+
+    ScopedTextBlend(const ScopedTextBlend&) = delete;
+    ScopedTextBlend& operator=(const ScopedTextBlend&) = delete;
+
+private:
+    bool blendEnabled;
+    int blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha;
+};
+
+// 複数のdrawStringをまとめて描画するバッチ
+// グリフのクアッドを（アトラス管理, アトラス番号）ごとの頂点配列に色付きで集め、
+// draw()でアトラスごとに1回だけ描画する。ブレンド設定の保存・復元もdraw()で1回だけ
+// 同じFontAtlasManagerを共有するフォント同士は同じ頂点配列にまとまる
+//
+// draw()以外はGLを使わないので、GPUなしで組み立て結果を確認できる
+class TextBatch {
+public:
+    struct Group {
+        FontAtlasManager* manager = nullptr;
+        size_t atlasIndex = 0;
+        int atlasWidth = 0;              // テクスチャ座標を計算した時のアトラスサイズ
+        int atlasHeight = 0;
+        uint64_t atlasReleaseCount = 0;  // アトラス番号が詰められたら描画できない
+        GlyphQuadBuffer quads;
+    };
+
+    TextBatch();
+
+    // クアッドを追加
+    void addQuad(FontAtlasManager* manager, size_t atlasIndex, const GlyphQuad& quad, const ofFloatColor& color);
+
+    // 以降に追加するクアッドの座標に掛ける行列（描画時の座標系との差）
+    // 頂点は2Dなので、奥行き方向の成分は捨てられる
+    void setTransform(const glm::mat4& transform);
+    void resetTransform();
+
+    // 追加したクアッドを全て削除（確保済みの配列は再利用する）
+    void clear();
+
+    // アトラスが拡張されていたらテクスチャ座標を合わせる（draw()からも呼ばれる）
+    void syncAtlasSizes();
+
+    // アトラスごとに1回ずつ描画
+    void draw();
+
+    size_t getQuadCount() const { return quadCount; }
+    bool empty() const { return quadCount == 0; }
+
+    // 使用中のグループ（manager == nullptrのものは空き）
+    const std::vector<Group>& getGroups() const { return groups; }
+
+private:
+    std::vector<Group> groups;
+    size_t lastGroup = 0;
+    size_t quadCount = 0;
+    glm::mat4 transform;
+    bool hasTransform = false;
+
+    Group& getGroup(FontAtlasManager* manager, size_t atlasIndex);
+    void syncAtlasSize(Group& group);
+};
@@ -0,0 +1,56 @@
+#include "TextCommandBuffer.h"
+#include "ofxTrueTypeFontLowRAM.h"
+#include "ofAppRunner.h"
+
+using namespace std;
+
+void TextCommandBuffer::reserve(size_t glyphCount) {
+    glyphs.reserve(glyphCount);
+}
+
+void TextCommandBuffer::addGlyph(FontAtlasManager* manager, const Glyph& glyph, const ofFloatColor& color) {
+    // 同じフォント・色の文字列が続くので、直前のランに足すだけのことが多い
+    if (runs.empty() || runs.back().manager != manager || runs.back().color != color) {
+        runs.push_back({manager, color, 0});
+    }
+    runs.back().glyphCount++;
+    glyphs.push_back(glyph);
+}
+
+void TextCommandBuffer::clear() {
+    glyphs.clear();
+    runs.clear();
+}
+
+size_t TextCommandBuffer::submit(TextBatch& batch) const {
+    size_t added = 0;
+    size_t next = 0;
+    FontAtlasManager* lastManager = nullptr;
+    for (const auto& run : runs) {
+        FontAtlasManager* manager = run.manager;
+        if (manager != lastManager) {
+            // 追い出し判定用に使用フレームを記録
+            manager->setCurrentFrame(ofGetFrameNum());
+            lastManager = manager;
+        }
+
+        for (size_t i = 0; i < run.glyphCount; i++) {
+            const Glyph& glyph = glyphs[next++];
+            const LazyGlyphProps* props = manager->getOrLoadGlyph(glyph.codepoint);
+            if (!props || !props->hasBitmap) continue;
+
+            GlyphQuad quad;
+            quad.x0 = glyph.x0;
+            quad.y0 = glyph.y0;
+            quad.x1 = glyph.x1;
+            quad.y1 = glyph.y1;
+            quad.u0 = props->t1;
+            quad.v0 = props->v1;
+            quad.u1 = props->t2;
+            quad.v1 = props->v2;
+            batch.addQuad(manager, props->atlasIndex, quad, run.color);
+            added++;
+        }
+    }
+    return added;
+}
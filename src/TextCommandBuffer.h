@@ -0,0 +1,54 @@
+#pragma once
+
+#include "GlyphQuadBuffer.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class FontAtlasManager;
+class TextBatch;
+
+// どのスレッドでも組み立てられるテキストの描画コマンド
+// レイアウト（送り幅・カーニング・クアッドの画面座標）はメトリクスだけで済ませ、
+// アトラス上の位置（テクスチャ座標）はsubmit()の時にGLスレッドで引く
+// 未ロードのグリフもsubmit()でラスタライズ・配置されるので、組み立てる側はアトラスに触れない
+//
+// 1つのバッファを複数のスレッドで同時に組み立ててはいけない（スレッドごとに持ち、GLスレッドでまとめて送る）
+class TextCommandBuffer {
+public:
+    // グリフ1つ分（画面座標はGlyphQuadと同じ）
+    struct Glyph {
+        uint32_t codepoint;
+        float x0, y0, x1, y1;
+    };
+
+    // 同じアトラス管理・色で続くグリフの数
+    struct Run {
+        FontAtlasManager* manager;
+        ofFloatColor color;
+        size_t glyphCount;
+    };
+
+    void reserve(size_t glyphCount);
+
+    // グリフを追加
+    void addGlyph(FontAtlasManager* manager, const Glyph& glyph, const ofFloatColor& color);
+
+    // 追加したグリフを全て削除（確保済みの配列は再利用する）
+    void clear();
+
+    // GLスレッドで呼ぶ。グリフをロード・配置してテクスチャ座標を付け、バッチに追加する（戻り値は追加したクアッド数）
+    // 複数のバッファを同じバッチに送れば、batch.draw()でアトラスごとに1回の描画にまとまる
+    // バックグラウンドでラスタライズ中のグリフは追加されない
+    size_t submit(TextBatch& batch) const;
+
+    size_t getGlyphCount() const { return glyphs.size(); }
+    bool empty() const { return glyphs.empty(); }
+
+    const std::vector<Glyph>& getGlyphs() const { return glyphs; }
+    const std::vector<Run>& getRuns() const { return runs; }
+
+private:
+    std::vector<Glyph> glyphs;
+    std::vector<Run> runs;
+};
@@ -1,22 +1,36 @@
 #include "ofxTrueTypeFontLowRAM.h"
+#include "MappedFile.h"
+#include "GlyphRasterizer.h"
+#include "SharedGlyphStore.h"
 #include "ofGraphics.h"
 #include "ofAppRunner.h"
 #include "ofUtils.h"
+#include "ofGLUtils.h"
+#include "ofThread.h"
+
+#include <climits>
+#include <cstring>
+#include <fstream>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
+#include FT_OUTLINE_H
+#include FT_SIZES_H
 
 #ifdef TARGET_OSX
 #include <CoreText/CoreText.h>
 #endif
 
 // FreeTypeライブラリ（グローバル）
+// フェイスの作成・破棄はライブラリ単位で直列化する必要があるので、ftLibraryMutexを持って行う
 static FT_Library ftLibrary = nullptr;
 static int ftLibraryRefCount = 0;
+static std::mutex ftLibraryMutex;
 
 // FreeTypeライブラリ初期化
 static bool initFreeType() {
+    lock_guard<mutex> lock(ftLibraryMutex);
     if (ftLibrary == nullptr) {
         if (FT_Init_FreeType(&ftLibrary)) {
             ofLogError("ofxTrueTypeFontLowRAM") << "Failed to initialize FreeType library";
@@ -29,6 +43,7 @@ static bool initFreeType() {
 
 // FreeTypeライブラリ解放
 static void releaseFreeType() {
+    lock_guard<mutex> lock(ftLibraryMutex);
     ftLibraryRefCount--;
     if (ftLibraryRefCount <= 0 && ftLibrary != nullptr) {
         FT_Done_FreeType(ftLibrary);
@@ -63,6 +78,26 @@ static of::filesystem::path osxFontPathByName(const string& fontName) {
 }
 #endif
 
+// フォントファイルの内容のハッシュ（FNV-1aを8バイト単位で）
+static uint64_t hashFontFile(const of::filesystem::path& path) {
+    MappedFile file;
+    if (!file.open(path)) return 0;
+
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ uint64_t(file.size());
+    const uint8_t* data = file.data();
+    size_t words = file.size() / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t word;
+        memcpy(&word, data + i * 8, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (size_t i = words * 8; i < file.size(); i++) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash;
+}
+
 // フォントパスを解決する（システムフォントも対応）
 static of::filesystem::path resolveFontPath(const of::filesystem::path& fontPath) {
     // まずdataフォルダ内を探す
@@ -114,6 +149,22 @@ FontAtlasManager::~FontAtlasManager() {
     // ので、ここでは何もしない
     //
     // 注意: 動的にフォントをロード/アンロードする場合は別途対応が必要
+    //
+    // FT_Sizeはフェイスを共有している他のサイズがあるので、ここで解放する
+    // （フェイスより先に解放する必要がある。フェイスを閉じる時にも解放されるので、
+    //  終了時にftLibraryがない場合は何もしない）
+    if (ftSize && ftLibrary != nullptr) {
+        lock_guard<mutex> faceLock(*faceMutex);
+        FT_Done_Size(ftSize);
+    }
+}
+
+void FontAtlasManager::activateSize() const {
+    // 同じフェイスを他のサイズと共有しているので、毎回このアトラスのサイズに切り替える
+    // （ポインタを差し替えるだけなので軽い）
+    if (face && face->size != ftSize) {
+        FT_Activate_Size(ftSize);
+    }
 }
 
 int FontAtlasManager::getMaxTextureSize() {
@@ -127,7 +178,8 @@ int FontAtlasManager::getMaxTextureSize() {
     return maxSize;
 }
 
-bool FontAtlasManager::setup(const of::filesystem::path& fontPath, int size, bool antialias, int dpiValue) {
+bool FontAtlasManager::setup(const of::filesystem::path& fontPath, int size, bool antialias, int dpiValue,
+                             const FontAtlasOptions& atlasOptions) {
     if (!initFreeType()) {
         return false;
     }
@@ -135,10 +187,16 @@ bool FontAtlasManager::setup(const of::filesystem::path& fontPath, int size, boo
     fontSize = size;
     antialiased = antialias;
     dpi = (dpiValue > 0) ? dpiValue : 96;
+    options = atlasOptions;
 
-    // 最大テクスチャサイズを取得
-    maxAtlasSize = getMaxTextureSize();
-    ofLogVerbose("ofxTrueTypeFontLowRAM") << "Max texture size: " << maxAtlasSize;
+#ifdef TARGET_OPENGLES
+    // GLESではスウィズルが使えないので1チャンネルは不可
+    if (options.singleChannel) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "singleChannel atlas is not supported on GLES, using GRAY_ALPHA";
+        options.singleChannel = false;
+    }
+#endif
+    atlasFormat = options.singleChannel ? OF_PIXELS_GRAY : OF_PIXELS_GRAY_ALPHA;
 
     // 最小サイズは fontSize * 4
     minAtlasSize = max(64, fontSize * 4);
@@ -156,24 +214,63 @@ bool FontAtlasManager::setup(const of::filesystem::path& fontPath, int size, boo
         releaseFreeType();
         return false;
     }
+    fontFilePath = resolvedPath;
 
-    // FT_Faceをロード
-    FT_Face rawFace;
-    FT_Error err = FT_New_Face(ftLibrary, resolvedPath.string().c_str(), 0, &rawFace);
-    if (err) {
-        ofLogError("ofxTrueTypeFontLowRAM") << "Failed to load font: " << fontPath;
+    // 前回のアトラスがディスクにあれば読み込む（フェイスは不要）
+    if (!options.atlasCacheDirectory.empty() || !options.sharedGlyphStoreDirectory.empty()) {
+        fontFileHash = hashFontFile(fontFilePath);
+    }
+    if (!options.atlasCacheDirectory.empty()) {
+        loadAtlasCache();
+    }
+    if (!options.sharedGlyphStoreDirectory.empty()) {
+        openSharedGlyphStore();
+    }
+    if (!options.usageProfileDirectory.empty()) {
+        recordingUsage = true;
+        loadUsageProfile();
+    }
+    memoryUsage = computeMemoryUsage();
+
+    // 遅延ロードならフェイスは最初に使う時に開く
+    if (options.deferFaceLoad) {
+        return true;
+    }
+
+    if (!openFace()) {
         releaseFreeType();
         return false;
     }
 
-    // shared_ptrで管理
-    // 注意: プログラム終了時、static変数の破棄順序が不定のため
-    // ftLibraryがnullptrの場合はFT_Done_Faceを呼ばない
-    face = shared_ptr<FT_FaceRec_>(rawFace, [](FT_Face f) {
-        if (ftLibrary != nullptr) {
-            FT_Done_Face(f);
-        }
-    });
+    // アトラスは最初のグリフを配置する時に作成する（予算の判定を通すため）
+
+    return true;
+}
+
+bool FontAtlasManager::openFace() {
+    lock_guard<mutex> lock(openMutex);
+    if (faceOpened) return true;
+    if (faceOpenFailed) return false;
+
+    // FT_Faceを取得（同じファイルの他のサイズと共有）
+    FontFacePool& pool = FontFacePool::getInstance();
+    face = pool.acquire(fontFilePath, options.memoryMapFont);
+    if (!face) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "Failed to load font: " << fontFilePath;
+        faceOpenFailed = true;
+        return false;
+    }
+    faceMutex = pool.getFaceMutex(fontFilePath);
+    lock_guard<mutex> faceLock(*faceMutex);
+
+    // このアトラス専用のサイズを作成
+    if (FT_New_Size(face.get(), &ftSize)) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "Failed to create size for font: " << fontFilePath;
+        face.reset();
+        faceOpenFailed = true;
+        return false;
+    }
+    FT_Activate_Size(ftSize);
 
     // フォントサイズ設定
     FT_Set_Char_Size(face.get(), fontSize << 6, fontSize << 6, dpi, dpi);
@@ -184,17 +281,20 @@ bool FontAtlasManager::setup(const of::filesystem::path& fontPath, int size, boo
     ascenderHeight = int26p6_to_dbl(face->size->metrics.ascender);
     descenderHeight = int26p6_to_dbl(face->size->metrics.descender);
 
+    // カーニングの有無はここで一度だけ調べる
+    kerningAvailable = FT_HAS_KERNING(face.get());
+
     // スペースのadvanceを取得
     FT_UInt spaceIndex = FT_Get_Char_Index(face.get(), ' ');
+    spaceGlyphIndex = spaceIndex;
+    tabGlyphIndex = FT_Get_Char_Index(face.get(), '\t');
     if (FT_Load_Glyph(face.get(), spaceIndex, FT_LOAD_NO_HINTING) == 0) {
         spaceAdvance = int26p6_to_dbl(face->glyph->metrics.horiAdvance);
     } else {
         spaceAdvance = fontSize * 0.5f;  // フォールバック
     }
 
-    // 最初のアトラスを作成
-    createNewAtlas();
-
+    faceOpened = true;
     return true;
 }
 
@@ -208,29 +308,20 @@ size_t FontAtlasManager::createNewAtlas() {
     AtlasState state;
     state.width = size;
     state.height = size;
-    state.currentX = border;
-    state.currentY = border;
-    state.currentRowHeight = 0;
-    atlasStates.push_back(state);
+    state.packer = GlyphPacker::create(options.packer);
+    state.packer->reset(size, size, border);
+    atlasStates.push_back(std::move(state));
 
-    // CPU側ピクセルバッファ
+    // CPU側ピクセルバッファ（保持しない設定なら空のまま）
     ofPixels pixels;
-    pixels.allocate(size, size, OF_PIXELS_GRAY_ALPHA);
-    pixels.set(0, 255);  // ルミナンス = 白
-    pixels.set(1, 0);    // アルファ = 透明
-    atlasPixels.push_back(pixels);
-
-    // GPU側テクスチャ
-    ofTexture tex;
-    tex.allocate(pixels, false);
-    tex.setRGToRGBASwizzles(true);
-    if (antialiased && fontSize > 20) {
-        tex.setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
-    } else {
-        tex.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+    if (options.keepCpuPixels) {
+        pixels.allocate(size, size, atlasFormat);
+        clearAtlasPixels(pixels);
     }
-    tex.loadData(pixels);
-    atlases.push_back(std::move(tex));
+    atlasPixels.push_back(std::move(pixels));
+
+    // GPU側テクスチャ（確保と転送は次のflushUploadsで行う）
+    atlases.push_back(ofTexture());
 
     return atlases.size() - 1;
 }
@@ -248,35 +339,31 @@ bool FontAtlasManager::expandAtlas(size_t atlasIndex) {
 
     ofLogVerbose("ofxTrueTypeFontLowRAM") << "Expanding atlas: " << state.width << " -> " << newSize;
 
-    // 新しいピクセルバッファを作成
-    ofPixels newPixels;
-    newPixels.allocate(newSize, newSize, OF_PIXELS_GRAY_ALPHA);
-    newPixels.set(0, 255);
-    newPixels.set(1, 0);
+    if (options.keepCpuPixels) {
+        // 新しいピクセルバッファを作成
+        ofPixels newPixels;
+        newPixels.allocate(newSize, newSize, atlasFormat);
+        clearAtlasPixels(newPixels);
 
-    // 既存のピクセルをコピー
-    ofPixels& oldPixels = atlasPixels[atlasIndex];
-    oldPixels.pasteInto(newPixels, 0, 0);
+        // 既存のピクセルをコピー
+        atlasPixels[atlasIndex].pasteInto(newPixels, 0, 0);
+        atlasPixels[atlasIndex] = std::move(newPixels);
+    }
 
     // 状態更新
+    bool textureWasUploaded = !state.textureStale;
     state.width = newSize;
     state.height = newSize;
-    atlasPixels[atlasIndex] = std::move(newPixels);
+    state.packer->grow(newSize, newSize);
 
-    // GPUテクスチャを再作成
-    atlases[atlasIndex].clear();
-    atlases[atlasIndex].allocate(atlasPixels[atlasIndex], false);
-    atlases[atlasIndex].setRGToRGBASwizzles(true);
-    if (antialiased && fontSize > 20) {
-        atlases[atlasIndex].setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
-    } else {
-        atlases[atlasIndex].setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
-    }
-    atlases[atlasIndex].loadData(atlasPixels[atlasIndex]);
+    // GPUテクスチャは次のflushUploadsで再作成する
+    // （同じフレーム内で複数回拡張しても再確保は1回で済む）
+    state.textureStale = true;
+    layoutGeneration++;  // テクスチャ座標が変わる
 
     // 既存グリフのテクスチャ座標を再計算
-    for (auto& [codepoint, props] : glyphs) {
-        if (props.atlasIndex == atlasIndex) {
+    glyphs.forEach([&](uint32_t codepoint, LazyGlyphProps& props) {
+        if (props.hasBitmap && props.atlasIndex == atlasIndex) {
             // テクスチャ座標を新しいサイズに合わせて再計算
             // 古いサイズでのピクセル位置を逆算
             float oldW = state.width / 2.0f;
@@ -289,83 +376,90 @@ bool FontAtlasManager::expandAtlas(size_t atlasIndex) {
             props.v1 = (props.v1 * oldH) / newH;
             props.v2 = (props.v2 * oldH) / newH;
         }
+    });
+
+    if (!options.keepCpuPixels && textureWasUploaded) {
+        // 新しいテクスチャには何も残らないので、常駐グリフを書き戻す
+        // （まだ一度も転送していなければ転送待ちのグリフがそのまま使える）
+        rerasterizeAtlas(atlasIndex);
     }
 
     return true;
 }
 
-bool FontAtlasManager::rasterizeGlyph(uint32_t codepoint, ofPixels& outPixels, LazyGlyphProps& outProps) {
-    if (!face) return false;
+void FontAtlasManager::rerasterizeAtlas(size_t atlasIndex) {
+    // 拡張前に積まれていた分も含めて作り直すので捨てる
+    pendingUploads.erase(remove_if(pendingUploads.begin(), pendingUploads.end(),
+                                   [atlasIndex](const PendingUpload& p) { return p.atlasIndex == atlasIndex; }),
+                         pendingUploads.end());
+
+    glyphs.forEach([&](uint32_t codepoint, const LazyGlyphProps& props) {
+        if (!props.hasBitmap || props.atlasIndex != atlasIndex || props.atlasW == 0 || props.atlasH == 0) return;
+
+        // 配置した時と大きさが違えば隣のグリフを上書きしてしまうので書き戻さない
+        LazyGlyphProps tmpProps;
+        ofPixels glyphPixels;
+        if (rasterizeGlyph(codepoint, glyphPixels, tmpProps) && int(glyphPixels.getWidth()) == props.atlasW &&
+            int(glyphPixels.getHeight()) == props.atlasH) {
+            pendingUploads.push_back({atlasIndex, props.atlasX, props.atlasY, std::move(glyphPixels)});
+        }
+    });
+}
+
+bool FontAtlasManager::loadGlyphSlot(uint32_t codepoint, LazyGlyphProps& outProps) {
+    activateSize();
 
     FT_UInt glyphIndex = FT_Get_Char_Index(face.get(), codepoint);
     if (glyphIndex == 0) {
         // 存在しないグリフ
+        missingGlyphs.insert(codepoint);
         return false;
     }
 
+    // ビットマップは作らない（FT_LOAD_RENDERを付けない）
+    // ラスタライズ時と同じフラグにして、計測と描画でメトリクスを一致させる
     FT_Error err = FT_Load_Glyph(face.get(), glyphIndex, FT_LOAD_NO_HINTING);
     if (err) {
+        // 失敗も記録して、以降は問い合わせない（警告も1回だけ）
         ofLogWarning("ofxTrueTypeFontLowRAM") << "Failed to load glyph: " << codepoint;
+        missingGlyphs.insert(codepoint);
         return false;
     }
 
-    // ラスタライズ
-    if (antialiased) {
-        FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
-    } else {
-        FT_Render_Glyph(face->glyph, FT_RENDER_MODE_MONO);
-    }
-
-    FT_Bitmap& bitmap = face->glyph->bitmap;
-    int width = bitmap.width;
-    int height = bitmap.rows;
-
-    // プロパティ設定（ofTrueTypeFontと同じ計算方法）
-    outProps.width = int26p6_to_dbl(face->glyph->metrics.width);
-    outProps.height = int26p6_to_dbl(face->glyph->metrics.height);
-    outProps.bearingX = int26p6_to_dbl(face->glyph->metrics.horiBearingX);
-    outProps.bearingY = int26p6_to_dbl(face->glyph->metrics.horiBearingY);
-    outProps.advance = int26p6_to_dbl(face->glyph->metrics.horiAdvance);
-    // xmin/ymin/xmax/ymaxはbitmap_left/bitmap_topから計算（重要！）
-    outProps.xmin = face->glyph->bitmap_left;
-    outProps.xmax = outProps.xmin + outProps.width;
-    outProps.ymin = -face->glyph->bitmap_top;  // マイナスが重要
-    outProps.ymax = outProps.ymin + outProps.height;
-    outProps.tW = width;
-    outProps.tH = height;
-
-    if (width == 0 || height == 0) {
-        // スペースなど描画不要な文字
-        outPixels.clear();
-        return true;
+    outProps = LazyGlyphProps();
+    outProps.glyphIndex = glyphIndex;
+    return true;
+}
+
+bool FontAtlasManager::loadGlyphMetrics(uint32_t codepoint, LazyGlyphProps& outProps) {
+    if (!ensureFace()) return false;
+    lock_guard<mutex> faceLock(*faceMutex);
+    if (!loadGlyphSlot(codepoint, outProps)) {
+        return false;
     }
+    GlyphRasterizer::setGlyphPropsFromSlot(face->glyph, antialiased, outProps);
+    outProps.hasBitmap = false;
+    return true;
+}
 
-    // ピクセルデータを作成
-    outPixels.allocate(width, height, OF_PIXELS_GRAY_ALPHA);
-    outPixels.set(0, 255);  // ルミナンス = 白
-    outPixels.set(1, 0);    // アルファ = 透明
+bool FontAtlasManager::rasterizeGlyph(uint32_t codepoint, ofPixels& outPixels, LazyGlyphProps& outProps) {
+    // 他のプロセスがラスタライズ済みならコピーするだけ
+    if (sharedStore && sharedStore->find(codepoint, outProps, outPixels)) {
+        sharedStoreHits++;
+        return true;
+    }
 
-    if (antialiased) {
-        // グレースケール
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                unsigned char alpha = bitmap.buffer[y * bitmap.pitch + x];
-                outPixels.setColor(x, y, ofColor(255, alpha));
-            }
-        }
-    } else {
-        // モノクロ（1ビット）
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                int byteIndex = x / 8;
-                int bitIndex = 7 - (x % 8);
-                unsigned char byte = bitmap.buffer[y * bitmap.pitch + byteIndex];
-                unsigned char alpha = (byte & (1 << bitIndex)) ? 255 : 0;
-                outPixels.setColor(x, y, ofColor(255, alpha));
-            }
+    if (!ensureFace()) return false;
+    {
+        lock_guard<mutex> faceLock(*faceMutex);
+        if (!loadGlyphSlot(codepoint, outProps)) {
+            return false;
         }
+        GlyphRasterizer::renderLoadedGlyph(face->glyph, antialiased, atlasFormat, outPixels, outProps);
+    }
+    if (sharedStore) {
+        sharedStore->publish(codepoint, outProps, outPixels);
     }
-
     return true;
 }
 
@@ -374,60 +468,53 @@ bool FontAtlasManager::addGlyphToAtlas(uint32_t codepoint, LazyGlyphProps& outPr
     if (!rasterizeGlyph(codepoint, glyphPixels, outProps)) {
         return false;
     }
+    return placeGlyph(codepoint, glyphPixels, outProps);
+}
+
+bool FontAtlasManager::placeGlyph(uint32_t codepoint, ofPixels& glyphPixels, LazyGlyphProps& outProps) {
+    // 最大テクスチャサイズはGLが必要なので、最初にアトラスを使う時に取得する
+    // （メトリクスだけならGLコンテキストは不要）
+    if (!maxAtlasSizeQueried) {
+        maxAtlasSize = getMaxTextureSize();
+        maxAtlasSizeQueried = true;
+        ofLogVerbose("ofxTrueTypeFontLowRAM") << "Max texture size: " << maxAtlasSize;
+    }
 
     int glyphW = glyphPixels.getWidth();
     int glyphH = glyphPixels.getHeight();
 
+    outProps.hasBitmap = true;
+
     if (glyphW == 0 || glyphH == 0) {
         // スペースなど（テクスチャ不要）
         outProps.atlasIndex = 0;
+        outProps.atlasX = outProps.atlasY = 0;
+        outProps.atlasW = outProps.atlasH = 0;
         outProps.t1 = outProps.t2 = outProps.v1 = outProps.v2 = 0;
         return true;
     }
 
-    // 最後のアトラスに追加を試みる
-    size_t atlasIndex = atlases.size() - 1;
-    AtlasState& state = atlasStates[atlasIndex];
-
-    // 現在の行に収まるかチェック
-    if (state.currentX + glyphW + border > state.width) {
-        // 次の行へ
-        state.currentX = border;
-        state.currentY += state.currentRowHeight + border;
-        state.currentRowHeight = 0;
-    }
-
-    // 高さが足りるかチェック
-    if (state.currentY + glyphH + border > state.height) {
-        // アトラスを拡張
-        if (!expandAtlas(atlasIndex)) {
-            // 拡張できなかった → 新しいアトラスを作成
-            atlasIndex = createNewAtlas();
-            state = atlasStates[atlasIndex];
-        }
-    }
-
-    // 再度チェック（拡張後）
-    AtlasState& currentState = atlasStates[atlasIndex];
-    if (currentState.currentX + glyphW + border > currentState.width) {
-        currentState.currentX = border;
-        currentState.currentY += currentState.currentRowHeight + border;
-        currentState.currentRowHeight = 0;
+    if (glyphW + border * 2 > maxAtlasSize || glyphH + border * 2 > maxAtlasSize) {
+        // 最大テクスチャサイズより大きいグリフは何度試しても入らない
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "Glyph too large for atlas: " << codepoint;
+        missingGlyphs.insert(codepoint);
+        return false;
     }
 
-    if (currentState.currentY + glyphH + border > currentState.height) {
-        // それでも入らない → さらに拡張 or 新アトラス
-        if (!expandAtlas(atlasIndex)) {
-            atlasIndex = createNewAtlas();
-            currentState = atlasStates[atlasIndex];
-        }
+    size_t atlasIndex = 0;
+    int x = 0;
+    int y = 0;
+    if (!allocateRegion(glyphW, glyphH, atlasIndex, x, y)) {
+        refuseGlyph(codepoint);
+        return false;
     }
+    const AtlasState& currentState = atlasStates[atlasIndex];
 
     // グリフをアトラスにペースト
-    int x = currentState.currentX;
-    int y = currentState.currentY;
-
-    glyphPixels.pasteInto(atlasPixels[atlasIndex], x, y);
+    outProps.atlasX = x;
+    outProps.atlasY = y;
+    outProps.atlasW = glyphW;
+    outProps.atlasH = glyphH;
 
     // テクスチャ座標を計算
     float atlasW = float(currentState.width);
@@ -437,207 +524,1856 @@ bool FontAtlasManager::addGlyphToAtlas(uint32_t codepoint, LazyGlyphProps& outPr
     outProps.v1 = float(y) / atlasH;
     outProps.t2 = float(x + glyphW) / atlasW;
     outProps.v2 = float(y + glyphH) / atlasH;
+    atlasStates[atlasIndex].glyphCount++;
 
-    // 書き込み位置を更新
-    currentState.currentX += glyphW + border;
-    currentState.currentRowHeight = max(currentState.currentRowHeight, glyphH);
-
-    // GPUにアップロード
-    atlases[atlasIndex].loadData(atlasPixels[atlasIndex]);
+    // GPUへの転送は描画前のflushUploadsでまとめて行う
+    if (options.keepCpuPixels) {
+        glyphPixels.pasteInto(atlasPixels[atlasIndex], x, y);
+        markDirty(atlasIndex, x, y, glyphW, glyphH);
+    } else {
+        pendingUploads.push_back({atlasIndex, x, y, std::move(glyphPixels)});
+    }
 
     return true;
 }
 
-const LazyGlyphProps* FontAtlasManager::getOrLoadGlyph(uint32_t codepoint) {
-    auto it = glyphs.find(codepoint);
-    if (it != glyphs.end()) {
-        return &it->second;
+bool FontAtlasManager::allocateRegion(int w, int h, size_t& outAtlasIndex, int& outX, int& outY) {
+    if (findFreeSpace(w, h, outAtlasIndex, outX, outY)) {
+        return true;
     }
 
-    // 遅延ロード
-    LazyGlyphProps props;
-    if (!addGlyphToAtlas(codepoint, props)) {
-        return nullptr;
+    // 最後のアトラスを拡張 → 新しいアトラス
+    bool triedEviction = false;
+    while (true) {
+        bool hasAtlas = !atlasStates.empty();
+        int size = hasAtlas ? atlasStates.back().width : minAtlasSize;
+        bool canExpand = hasAtlas && size * 2 <= maxAtlasSize;
+        size_t growth = canExpand ? getAtlasBytes(size * 2) - getAtlasBytes(size) : getAtlasBytes(size);
+
+        // 全体の予算はここでは判定だけ（他のフォントからの回収は自分の追い出しで足りない時に限る）
+        bool withinLocal = isWithinBudget(growth, !canExpand);
+        bool withinGlobal = reserveGrowth(growth, false);
+        if ((!withinLocal || !withinGlobal) && !triedEviction) {
+            // 予算を超えるので、まず使われていないグリフを追い出して再利用する
+            triedEviction = true;
+            if (evictStaleGlyphsLocked(currentFrame) > 0 && findFreeSpace(w, h, outAtlasIndex, outX, outY)) {
+                return true;
+            }
+            continue;
+        }
+        if (!withinGlobal) {
+            withinGlobal = reserveGrowth(growth, true);
+        }
+        if (!withinGlobal) {
+            // 共有キャッシュ全体の予算は厳守（このグリフは描画されない）
+            if (!refusedWarningShown) {
+                ofLogWarning("ofxTrueTypeFontLowRAM") << "Font cache memory budget exceeded, glyphs skipped";
+                refusedWarningShown = true;
+            }
+            return false;
+        }
+        if (!withinLocal && !budgetWarningShown) {
+            ofLogWarning("ofxTrueTypeFontLowRAM") << "Atlas memory budget exceeded: no glyphs old enough to evict";
+            budgetWarningShown = true;
+        }
+
+        if (canExpand) {
+            expandAtlas(atlasStates.size() - 1);
+        } else {
+            if (hasAtlas && atlasStates.back().packer->getUsedArea() == 0) {
+                // 空のアトラスにも入らない（最大テクスチャサイズより大きい）
+                ofLogWarning("ofxTrueTypeFontLowRAM") << "Glyph too large for atlas: " << w << "x" << h;
+                return false;
+            }
+            createNewAtlas();
+        }
+
+        size_t atlasIndex = atlasStates.size() - 1;
+        if (atlasStates[atlasIndex].packer->pack(w, h, outX, outY)) {
+            outAtlasIndex = atlasIndex;
+            return true;
+        }
     }
+}
 
-    auto result = glyphs.emplace(codepoint, props);
-    return &result.first->second;
+void FontAtlasManager::refuseGlyph(uint32_t codepoint) {
+    // 前回記録してからメモリが解放されていれば、古い記録は捨てる
+    uint64_t generation = SharedFontCache::getInstance().getFreedGeneration();
+    if (generation != refusedGeneration) {
+        refusedGlyphs.clear();
+        refusedGeneration = generation;
+    }
+    refusedGlyphs.insert(codepoint);
 }
 
-bool FontAtlasManager::hasGlyph(uint32_t codepoint) const {
-    return glyphs.find(codepoint) != glyphs.end();
+bool FontAtlasManager::isRefused(uint32_t codepoint) const {
+    if (refusedGlyphs.empty()) return false;
+    return refusedGeneration == SharedFontCache::getInstance().getFreedGeneration() && refusedGlyphs.count(codepoint) > 0;
 }
 
-const ofTexture& FontAtlasManager::getTexture(size_t atlasIndex) const {
-    static ofTexture emptyTex;
-    if (atlasIndex < atlases.size()) {
-        return atlases[atlasIndex];
+bool FontAtlasManager::findFreeSpace(int w, int h, size_t& outAtlasIndex, int& outX, int& outY) {
+    // 追い出したグリフの跡地
+    if (takeFreeRect(w, h, outAtlasIndex, outX, outY)) {
+        return true;
     }
-    return emptyTex;
+
+    // 既存のアトラス（新しいものから）
+    // 通常は最後以外は埋まっているが、追い出しで空になったアトラスも使えるように全て試す
+    for (size_t i = atlasStates.size(); i-- > 0;) {
+        if (atlasStates[i].packer->pack(w, h, outX, outY)) {
+            outAtlasIndex = i;
+            return true;
+        }
+    }
+    return false;
 }
 
-size_t FontAtlasManager::getMemoryUsage() const {
-    size_t total = 0;
+bool FontAtlasManager::reserveGrowth(size_t additionalBytes, bool reclaim) {
+    if (!growthGuard) return true;
+    // 共有キャッシュは他のアトラスと合計するので、ここまでの変更を反映しておく
+    refreshMemoryUsage();
+    return growthGuard(*this, additionalBytes, reclaim);
+}
 
-    // テクスチャメモリ（GPU + CPUコピー）
+bool FontAtlasManager::takeFreeRect(int w, int h, size_t& outAtlasIndex, int& outX, int& outY) {
+    // 面積が最も近い跡地を選ぶ
+    size_t bestAtlas = 0;
+    size_t bestRect = SIZE_MAX;
+    long bestWaste = LONG_MAX;
     for (size_t i = 0; i < atlasStates.size(); i++) {
-        // GRAY_ALPHA = 2バイト/ピクセル
-        size_t texSize = atlasStates[i].width * atlasStates[i].height * 2;
-        total += texSize * 2;  // GPU + CPU
+        const auto& rects = atlasStates[i].freeRects;
+        for (size_t r = 0; r < rects.size(); r++) {
+            if (rects[r].w < w || rects[r].h < h) continue;
+            long waste = long(rects[r].w) * rects[r].h - long(w) * h;
+            if (waste < bestWaste) {
+                bestWaste = waste;
+                bestAtlas = i;
+                bestRect = r;
+            }
+        }
+    }
+    if (bestRect == SIZE_MAX) {
+        return false;
     }
 
-    // グリフ情報
-    total += glyphs.size() * sizeof(LazyGlyphProps);
+    auto& rects = atlasStates[bestAtlas].freeRects;
+    FreeRect rect = rects[bestRect];
+    rects.erase(rects.begin() + bestRect);
 
-    return total;
-}
+    outAtlasIndex = bestAtlas;
+    outX = rect.x;
+    outY = rect.y;
 
-double FontAtlasManager::getKerning(uint32_t leftC, uint32_t rightC) const {
-    if (!face) return 0.0;
+    // 残りを右と下に分割（ボーダーを空ける）
+    int rightW = rect.w - w - border;
+    int bottomH = rect.h - h - border;
+    if (rightW > 0) {
+        rects.push_back({rect.x + w + border, rect.y, rightW, h});
+    }
+    if (bottomH > 0) {
+        rects.push_back({rect.x, rect.y + h + border, rect.w, bottomH});
+    }
+    return true;
+}
 
-    if (FT_HAS_KERNING(face.get())) {
-        FT_Vector kerning;
-        FT_Get_Kerning(face.get(),
-                       FT_Get_Char_Index(face.get(), leftC),
-                       FT_Get_Char_Index(face.get(), rightC),
-                       FT_KERNING_UNFITTED, &kerning);
-        return int26p6_to_dbl(kerning.x);
+bool FontAtlasManager::isWithinBudget(size_t additionalBytes, bool addsAtlas) const {
+    if (addsAtlas && options.maxAtlasCount > 0 && atlases.size() >= options.maxAtlasCount) {
+        return false;
+    }
+    if (options.memoryBudget > 0 && computeMemoryUsage() + additionalBytes > options.memoryBudget) {
+        return false;
     }
-    return 0.0;
+    return true;
 }
 
-// ===========================================================================
-// SharedFontCache 実装
-// ===========================================================================
+size_t FontAtlasManager::getAtlasBytes(int size) const {
+    size_t bytes = size_t(size) * size * getBytesPerPixel();
+    return options.keepCpuPixels ? bytes * 2 : bytes;  // GPU (+ CPU)
+}
 
-SharedFontCache& SharedFontCache::getInstance() {
-    static SharedFontCache instance;
-    return instance;
+bool FontAtlasManager::isEvictionEnabled() const {
+    return options.memoryBudget > 0 || options.maxAtlasCount > 0 ||
+           (growthGuard && SharedFontCache::getInstance().getMemoryBudget() > 0);
 }
 
-shared_ptr<FontAtlasManager> SharedFontCache::getOrCreate(const FontCacheKey& key, int dpi) {
-    auto it = cache.find(key);
-    if (it != cache.end()) {
-        return it->second;
+bool FontAtlasManager::markUsed(uint32_t codepoint, LazyGlyphProps& props) {
+    GlyphUsage* entry = nullptr;
+    if (recordingUsage) {
+        entry = usage.find(codepoint);
+        if (!entry) return false;
     }
 
-    auto manager = make_shared<FontAtlasManager>();
-    if (!manager->setup(key.fontPath, key.fontSize, key.antialiased, dpi)) {
-        return nullptr;
+    // 同じフレームで何度も使われるので、変わる時だけ書く
+    uint64_t frame = currentFrame;
+    if (props.lastUsedFrame != frame) {
+        props.lastUsedFrame = frame;
     }
-
-    cache[key] = manager;
-    return manager;
-}
-
-void SharedFontCache::release(const FontCacheKey& key) {
-    cache.erase(key);
+    if (entry) {
+        countUsage(*entry);
+    }
+    return true;
 }
 
-void SharedFontCache::clear() {
-    cache.clear();
-}
+void FontAtlasManager::touchGlyphs(const vector<uint32_t>& codepoints) {
+    // 使用状況の記録がまだない文字だけ、後で排他ロックを取って追加する
+    vector<uint32_t> unrecorded;
+    {
+        shared_lock<shared_mutex> lock(glyphMutex);
+        for (uint32_t c : codepoints) {
+            LazyGlyphProps* found = glyphs.find(c);
+            if (found && !markUsed(c, *found)) {
+                unrecorded.push_back(c);
+            }
+        }
+    }
+    if (unrecorded.empty()) return;
 
-size_t SharedFontCache::getTotalMemoryUsage() const {
-    size_t total = 0;
-    for (const auto& [key, manager] : cache) {
-        total += manager->getMemoryUsage();
+    WriteLock lock(*this);
+    for (uint32_t c : unrecorded) {
+        if (LazyGlyphProps* found = glyphs.find(c)) {
+            found->lastUsedFrame = currentFrame;
+            recordUsage(c);
+        }
     }
-    return total;
 }
 
-// ===========================================================================
-// ofxTrueTypeFontLowRAM 実装
-// ===========================================================================
-
-ofxTrueTypeFontLowRAM::ofxTrueTypeFontLowRAM() {
+void FontAtlasManager::setBudget(size_t memoryBudgetBytes, size_t maxAtlasCount) {
+    WriteLock lock(*this);
+    options.memoryBudget = memoryBudgetBytes;
+    options.maxAtlasCount = maxAtlasCount;
+    budgetWarningShown = false;
+    refusedWarningShown = false;
+    SharedFontCache::getInstance().notifyMemoryFreed();
 }
 
-ofxTrueTypeFontLowRAM::~ofxTrueTypeFontLowRAM() {
+size_t FontAtlasManager::evictStaleGlyphs() {
+    return evictStaleGlyphs(currentFrame);
 }
 
-ofxTrueTypeFontLowRAM::ofxTrueTypeFontLowRAM(const ofxTrueTypeFontLowRAM& other) {
-    atlasManager = other.atlasManager;
-    cacheKey = other.cacheKey;
-    bLoadedOk = other.bLoadedOk;
-    lineHeight = other.lineHeight;
-    ascenderHeight = other.ascenderHeight;
-    descenderHeight = other.descenderHeight;
-    letterSpacing = other.letterSpacing;
-    spaceSize = other.spaceSize;
+size_t FontAtlasManager::evictStaleGlyphs(uint64_t now) {
+    WriteLock lock(*this);
+    return evictStaleGlyphsLocked(now);
 }
 
-ofxTrueTypeFontLowRAM& ofxTrueTypeFontLowRAM::operator=(const ofxTrueTypeFontLowRAM& other) {
-    if (this != &other) {
-        atlasManager = other.atlasManager;
-        cacheKey = other.cacheKey;
-        bLoadedOk = other.bLoadedOk;
-        lineHeight = other.lineHeight;
-        ascenderHeight = other.ascenderHeight;
-        descenderHeight = other.descenderHeight;
-        letterSpacing = other.letterSpacing;
-        spaceSize = other.spaceSize;
-    }
-    return *this;
+size_t FontAtlasManager::releaseEmptyAtlases() {
+    WriteLock lock(*this);
+    return releaseEmptyAtlasesLocked();
 }
 
-ofxTrueTypeFontLowRAM::ofxTrueTypeFontLowRAM(ofxTrueTypeFontLowRAM&& other) noexcept {
-    atlasManager = std::move(other.atlasManager);
-    cacheKey = std::move(other.cacheKey);
-    bLoadedOk = other.bLoadedOk;
-    lineHeight = other.lineHeight;
-    ascenderHeight = other.ascenderHeight;
-    descenderHeight = other.descenderHeight;
-    letterSpacing = other.letterSpacing;
-    spaceSize = other.spaceSize;
-    other.bLoadedOk = false;
+size_t FontAtlasManager::tryReclaim(uint64_t now) {
+    unique_lock<shared_mutex> lock(glyphMutex, try_to_lock);
+    if (!lock.owns_lock()) return 0;
+    evictStaleGlyphsLocked(now);
+    size_t freedBytes = releaseEmptyAtlasesLocked();
+    refreshMemoryUsage();
+    return freedBytes;
 }
 
-ofxTrueTypeFontLowRAM& ofxTrueTypeFontLowRAM::operator=(ofxTrueTypeFontLowRAM&& other) noexcept {
-    if (this != &other) {
-        atlasManager = std::move(other.atlasManager);
-        cacheKey = std::move(other.cacheKey);
-        bLoadedOk = other.bLoadedOk;
-        lineHeight = other.lineHeight;
-        ascenderHeight = other.ascenderHeight;
-        descenderHeight = other.descenderHeight;
-        letterSpacing = other.letterSpacing;
-        spaceSize = other.spaceSize;
-        other.bLoadedOk = false;
+size_t FontAtlasManager::evictStaleGlyphsLocked(uint64_t now) {
+    uint64_t age = max<uint64_t>(1, options.evictAfterFrames);
+    if (now < age) return 0;
+    uint64_t threshold = now - age;
+
+    // 走査中に書き換えないよう、対象を集めてから処理する
+    vector<uint32_t> stale;
+    glyphs.forEach([&](uint32_t codepoint, const LazyGlyphProps& props) {
+        if (props.hasBitmap && props.lastUsedFrame <= threshold && props.atlasW > 0 && props.atlasH > 0) {
+            stale.push_back(codepoint);
+        }
+    });
+
+    for (uint32_t codepoint : stale) {
+        LazyGlyphProps& props = *glyphs.find(codepoint);
+
+        // 跡地（実際に配置したビットマップの範囲）を透明に戻して再利用リストへ
+        AtlasState& state = atlasStates[props.atlasIndex];
+        clearRegion(props.atlasIndex, props.atlasX, props.atlasY, props.atlasW, props.atlasH);
+        state.freeRects.push_back({props.atlasX, props.atlasY, props.atlasW, props.atlasH});
+        state.glyphCount--;
+
+        // メトリクスは残す（計測はそのまま使え、描画時に再ラスタライズされる）
+        props.hasBitmap = false;
+        props.atlasIndex = 0;
+        props.atlasX = props.atlasY = 0;
+        props.atlasW = props.atlasH = 0;
+        props.t1 = props.t2 = props.v1 = props.v2 = 0;
     }
-    return *this;
+    size_t count = stale.size();
+
+    // 空になったアトラスは丸ごと作り直す
+    if (count > 0) {
+        memoryChanged = true;
+        SharedFontCache::getInstance().notifyMemoryFreed();
+        layoutGeneration++;
+        for (size_t i = 0; i < atlasStates.size(); i++) {
+            if (atlasStates[i].glyphCount == 0) {
+                resetAtlas(i);
+            }
+        }
+        ofLogVerbose("ofxTrueTypeFontLowRAM") << "Evicted " << count << " glyphs";
+    }
+
+    evictedGlyphCount += count;
+    return count;
 }
 
-bool ofxTrueTypeFontLowRAM::load(const of::filesystem::path& filename,
-                                  int fontsize,
-                                  bool _bAntiAliased,
-                                  bool _bFullCharacterSet,
-                                  bool makeContours,
-                                  float simplifyAmt,
-                                  int dpi) {
-    if (makeContours) {
-        ofLogWarning("ofxTrueTypeFontLowRAM") << "makeContours is not supported";
+size_t FontAtlasManager::releaseEmptyAtlasesLocked() {
+    // 削除後のインデックス対応表
+    vector<size_t> remap(atlasStates.size(), SIZE_MAX);
+    size_t kept = 0;
+    size_t freedBytes = 0;
+    for (size_t i = 0; i < atlasStates.size(); i++) {
+        if (atlasStates[i].glyphCount == 0) {
+            freedBytes += getAtlasBytes(atlasStates[i].width);
+        } else {
+            remap[i] = kept++;
+        }
+    }
+    if (kept == atlasStates.size()) {
+        return 0;
     }
 
-    // キャッシュキー作成
-    cacheKey.fontPath = filename.string();
-    cacheKey.fontSize = fontsize;
-    cacheKey.antialiased = _bAntiAliased;
+    for (size_t i = 0; i < remap.size(); i++) {
+        if (remap[i] == SIZE_MAX || remap[i] == i) continue;
+        atlases[remap[i]] = std::move(atlases[i]);
+        atlasPixels[remap[i]] = std::move(atlasPixels[i]);
+        atlasStates[remap[i]] = std::move(atlasStates[i]);
+    }
+    atlases.resize(kept);
+    atlasPixels.resize(kept);
+    atlasStates.resize(kept);
+    memoryChanged = true;
+    SharedFontCache::getInstance().notifyMemoryFreed();
+
+    glyphs.forEach([&remap](uint32_t codepoint, LazyGlyphProps& props) {
+        if (!props.hasBitmap || props.atlasW == 0 || props.atlasH == 0) return;
+        props.atlasIndex = remap[props.atlasIndex];
+    });
 
-    // 共有キャッシュから取得
-    atlasManager = SharedFontCache::getInstance().getOrCreate(cacheKey, dpi);
-    if (!atlasManager) {
-        bLoadedOk = false;
-        return false;
+    pendingUploads.erase(remove_if(pendingUploads.begin(), pendingUploads.end(),
+                                   [&remap](const PendingUpload& p) { return remap[p.atlasIndex] == SIZE_MAX; }),
+                         pendingUploads.end());
+    for (auto& upload : pendingUploads) {
+        upload.atlasIndex = remap[upload.atlasIndex];
     }
 
-    // 親クラスのメンバーを設定
-    bLoadedOk = true;
-    lineHeight = atlasManager->getLineHeight();
-    ascenderHeight = atlasManager->getAscenderHeight();
-    descenderHeight = atlasManager->getDescenderHeight();
-    letterSpacing = 1.0f;
-    spaceSize = 1.0f;
+    // アトラス番号が変わる
+    layoutGeneration++;
+    atlasReleaseCount++;
+
+    ofLogVerbose("ofxTrueTypeFontLowRAM") << "Released " << (remap.size() - kept) << " empty atlas(es)";
+    return freedBytes;
+}
+
+void FontAtlasManager::clearRegion(size_t atlasIndex, int x, int y, int w, int h) {
+    if (options.keepCpuPixels) {
+        ofPixels& pixels = atlasPixels[atlasIndex];
+        size_t channels = pixels.getNumChannels();
+        size_t stride = pixels.getWidth() * channels;
+        for (int row = y; row < y + h; row++) {
+            unsigned char* dst = pixels.getData() + row * stride + x * channels;
+            if (channels == 1) {
+                memset(dst, 0, w);
+            } else {
+                for (int col = 0; col < w; col++) {
+                    dst[col * 2] = 255;
+                    dst[col * 2 + 1] = 0;
+                }
+            }
+        }
+        markDirty(atlasIndex, x, y, w, h);
+    } else {
+        ofPixels blank;
+        blank.allocate(w, h, atlasFormat);
+        clearAtlasPixels(blank);
+        pendingUploads.push_back({atlasIndex, x, y, std::move(blank)});
+    }
+}
+
+void FontAtlasManager::resetAtlas(size_t atlasIndex) {
+    AtlasState& state = atlasStates[atlasIndex];
+    state.packer->reset(state.width, state.height, border);
+    state.freeRects.clear();
+    state.glyphCount = 0;
+
+    if (options.keepCpuPixels) {
+        clearAtlasPixels(atlasPixels[atlasIndex]);
+    } else {
+        pendingUploads.erase(remove_if(pendingUploads.begin(), pendingUploads.end(),
+                                       [atlasIndex](const PendingUpload& p) { return p.atlasIndex == atlasIndex; }),
+                             pendingUploads.end());
+    }
+    // 全体を転送し直す
+    state.textureStale = true;
+}
+
+void FontAtlasManager::clearAtlasPixels(ofPixels& pixels) const {
+    if (atlasFormat == OF_PIXELS_GRAY) {
+        pixels.set(0, 0);    // カバレッジ = 0
+    } else {
+        pixels.set(0, 255);  // ルミナンス = 白
+        pixels.set(1, 0);    // アルファ = 透明
+    }
+}
+
+void FontAtlasManager::markDirty(size_t atlasIndex, int x, int y, int w, int h) {
+    AtlasState& state = atlasStates[atlasIndex];
+    if (state.textureStale) return;  // どうせ全体を転送する
+
+    if (state.dirtyX1 <= state.dirtyX0) {
+        state.dirtyX0 = x;
+        state.dirtyY0 = y;
+        state.dirtyX1 = x + w;
+        state.dirtyY1 = y + h;
+    } else {
+        state.dirtyX0 = min(state.dirtyX0, x);
+        state.dirtyY0 = min(state.dirtyY0, y);
+        state.dirtyX1 = max(state.dirtyX1, x + w);
+        state.dirtyY1 = max(state.dirtyY1, y + h);
+    }
+}
+
+void FontAtlasManager::allocateTexture(size_t atlasIndex) {
+    ofTexture& tex = atlases[atlasIndex];
+    const AtlasState& state = atlasStates[atlasIndex];
+    tex.clear();
+    if (options.keepCpuPixels) {
+        tex.allocate(atlasPixels[atlasIndex], false);
+    } else {
+        tex.allocate(state.width, state.height, ofGetGLInternalFormatFromPixelFormat(atlasFormat), false);
+    }
+#ifndef TARGET_OPENGLES
+    if (atlasFormat == OF_PIXELS_GRAY) {
+        // R8: RGBは常に白、アルファにカバレッジを展開
+        tex.setSwizzle(GL_TEXTURE_SWIZZLE_R, GL_ONE);
+        tex.setSwizzle(GL_TEXTURE_SWIZZLE_G, GL_ONE);
+        tex.setSwizzle(GL_TEXTURE_SWIZZLE_B, GL_ONE);
+        tex.setSwizzle(GL_TEXTURE_SWIZZLE_A, GL_RED);
+    } else
+#endif
+    {
+        tex.setRGToRGBASwizzles(true);
+    }
+    if (antialiased && fontSize > 20) {
+        tex.setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
+    } else {
+        tex.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+    }
+
+    if (options.keepCpuPixels) {
+        tex.loadData(atlasPixels[atlasIndex]);
+    } else {
+        // 確保直後の中身は不定なので、数行ずつ透明で埋める
+        const int stripRows = 16;
+        ofPixels strip;
+        strip.allocate(state.width, stripRows, atlasFormat);
+        clearAtlasPixels(strip);
+        for (int y = 0; y < state.height; y += stripRows) {
+            int rows = min(stripRows, state.height - y);
+            uploadPixels(atlasIndex, 0, y, state.width, rows, strip.getData(), state.width);
+        }
+    }
+}
+
+void FontAtlasManager::uploadRegion(size_t atlasIndex, int x, int y, int w, int h) {
+    const ofPixels& pixels = atlasPixels[atlasIndex];
+    int channels = pixels.getNumChannels();
+
+#ifdef TARGET_OPENGLES
+    // GLESにはGL_UNPACK_ROW_LENGTHがないので、行全体を転送する
+    x = 0;
+    w = pixels.getWidth();
+#endif
+
+    const unsigned char* src = pixels.getData() + (size_t(y) * pixels.getWidth() + x) * channels;
+    uploadPixels(atlasIndex, x, y, w, h, src, pixels.getWidth());
+}
+
+void FontAtlasManager::uploadPixels(size_t atlasIndex, int x, int y, int w, int h,
+                                    const unsigned char* data, int rowLength) {
+    const ofTextureData& texData = atlases[atlasIndex].getTextureData();
+
+    glBindTexture(texData.textureTarget, texData.textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+#ifndef TARGET_OPENGLES
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+#endif
+    glTexSubImage2D(texData.textureTarget, 0, x, y, w, h,
+                    ofGetGLFormatFromInternal(texData.glInternalFormat),
+                    ofGetGLTypeFromInternal(texData.glInternalFormat),
+                    data);
+#ifndef TARGET_OPENGLES
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(texData.textureTarget, 0);
+}
+
+void FontAtlasManager::flushUploads() {
+    WriteLock lock(*this);
+    for (size_t i = 0; i < atlasStates.size(); i++) {
+        AtlasState& state = atlasStates[i];
+        if (state.textureStale) {
+            allocateTexture(i);
+            state.textureStale = false;
+        } else if (state.dirtyX1 > state.dirtyX0) {
+            uploadRegion(i, state.dirtyX0, state.dirtyY0,
+                         state.dirtyX1 - state.dirtyX0, state.dirtyY1 - state.dirtyY0);
+        }
+        state.dirtyX0 = state.dirtyY0 = state.dirtyX1 = state.dirtyY1 = 0;
+    }
+
+    // CPU側コピーを持たない場合はグリフ単位で直接転送
+    if (!pendingUploads.empty()) {
+        memoryChanged = true;
+    }
+    for (const auto& upload : pendingUploads) {
+        int w = upload.pixels.getWidth();
+        int h = upload.pixels.getHeight();
+        uploadPixels(upload.atlasIndex, upload.x, upload.y, w, h, upload.pixels.getData(), w);
+    }
+    pendingUploads.clear();
+}
+
+void FontAtlasManager::setPlacement(LazyGlyphProps& entry, const LazyGlyphProps& placed) {
+    entry.atlasIndex = placed.atlasIndex;
+    entry.t1 = placed.t1;
+    entry.t2 = placed.t2;
+    entry.v1 = placed.v1;
+    entry.v2 = placed.v2;
+    entry.atlasX = placed.atlasX;
+    entry.atlasY = placed.atlasY;
+    entry.atlasW = placed.atlasW;
+    entry.atlasH = placed.atlasH;
+    entry.lastUsedFrame = placed.lastUsedFrame;
+    entry.hasBitmap = placed.hasBitmap;
+}
+
+const LazyGlyphProps* FontAtlasManager::getOrLoadGlyph(uint32_t codepoint) {
+    // 配置済みのグリフは共有ロックだけで返す（使った印はatomicに書く）
+    {
+        shared_lock<shared_mutex> lock(glyphMutex);
+        LazyGlyphProps* found = glyphs.find(codepoint);
+        if (found && found->hasBitmap && markUsed(codepoint, *found)) {
+            return found;
+        }
+    }
+
+    WriteLock lock(*this);
+    return getOrLoadGlyphLocked(codepoint);
+}
+
+const LazyGlyphProps* FontAtlasManager::getOrLoadGlyphLocked(uint32_t codepoint) {
+    if (recordingUsage) {
+        recordUsage(codepoint);
+    }
+
+    LazyGlyphProps* found = glyphs.find(codepoint);
+    if (found && found->hasBitmap) {
+        found->lastUsedFrame = currentFrame;
+        return found;
+    }
+
+    // ここから先はグリフ表・アトラスを変更し得る
+    memoryChanged = true;
+
+    // 存在しない・配置できないと分かっている文字はラスタライズし直さない
+    // 計測でメトリクスを読んであれば（アトラスより大きい文字など）、送り幅が変わらないようにそれを返す
+    if (missingGlyphs.count(codepoint)) {
+        if (found) return found;
+        missingLookupCount++;
+        return nullptr;
+    }
+
+    if (options.asyncRasterization) {
+        return requestGlyphAsync(codepoint, found);
+    }
+
+    // 予算で断られたばかりの文字は、メモリが空くまでラスタライズし直さない
+    if (isRefused(codepoint)) {
+        return nullptr;
+    }
+
+    // 遅延ロード
+    LazyGlyphProps props;
+    if (!addGlyphToAtlas(codepoint, props)) {
+        if (missingGlyphs.count(codepoint)) {
+            missingLookupCount++;
+        }
+        return nullptr;
+    }
+    props.lastUsedFrame = currentFrame;
+
+    // メトリクスだけ読んであった場合は同じ場所を更新する（ポインタを変えない）
+    if (found) {
+        setPlacement(*found, props);
+        return found;
+    }
+    return &glyphs.insert(codepoint, props);
+}
+
+const LazyGlyphProps* FontAtlasManager::requestGlyphAsync(uint32_t codepoint, LazyGlyphProps* found) {
+    // メトリクスは同期で読む（レイアウトは最初から正しい位置になる）
+    if (!found) {
+        LazyGlyphProps props;
+        if (!loadGlyphMetrics(codepoint, props)) {
+            missingLookupCount++;
+            return nullptr;
+        }
+        found = &glyphs.insert(codepoint, props);
+    }
+    found->lastUsedFrame = currentFrame;
+
+    // スペースなどビットマップのない文字はラスタライズ不要
+    if (found->tW == 0 || found->tH == 0) {
+        found->atlasIndex = 0;
+        found->atlasX = found->atlasY = 0;
+        found->atlasW = found->atlasH = 0;
+        found->t1 = found->t2 = found->v1 = found->v2 = 0;
+        found->hasBitmap = true;
+        return found;
+    }
+
+    // 配置できなかった（大きすぎる・予算で断られた）と分かっている文字は依頼し直さない
+    if (missingGlyphs.count(codepoint) || pendingGlyphs.count(codepoint) || isRefused(codepoint)) {
+        return found;
+    }
+
+    // 他のプロセスがラスタライズ済みなら待たずに配置する
+    if (sharedStore) {
+        LazyGlyphProps props;
+        ofPixels glyphPixels;
+        if (sharedStore->find(codepoint, props, glyphPixels)) {
+            sharedStoreHits++;
+            if (placeGlyph(codepoint, glyphPixels, props)) {
+                props.lastUsedFrame = currentFrame;
+                setPlacement(*found, props);
+            }
+            return found;
+        }
+    }
+
+    if (!rasterizer) {
+        rasterizer = make_unique<GlyphRasterizer>();
+    }
+    if (!rasterizer->isRunning() &&
+        !rasterizer->start(fontFilePath, fontSize, dpi, antialiased, atlasFormat, options.rasterizerThreads)) {
+        // ワーカーを起動できなければ同期でロードする
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "Failed to start rasterizer threads, loading glyphs synchronously";
+        options.asyncRasterization = false;
+        return getOrLoadGlyphLocked(codepoint);
+    }
+
+    pendingGlyphs.insert(codepoint);
+    rasterizer->request(codepoint);
+    return found;
+}
+
+void FontAtlasManager::setCurrentFrame(uint64_t frame) {
+    if (frame == currentFrame) return;
+
+    WriteLock lock(*this);
+    currentFrame = frame;
+
+    // フレームの境目で、ラスタライズの終わったグリフを予算分だけ配置する
+    if (!pendingGlyphs.empty()) {
+        integrateRasterizedGlyphsLocked(options.asyncGlyphsPerFrame);
+    }
+}
+
+size_t FontAtlasManager::getPendingGlyphCount() const {
+    shared_lock<shared_mutex> lock(glyphMutex);
+    return pendingGlyphs.size();
+}
+
+size_t FontAtlasManager::integrateRasterizedGlyphs(size_t maxCount) {
+    WriteLock lock(*this);
+    return integrateRasterizedGlyphsLocked(maxCount);
+}
+
+size_t FontAtlasManager::integrateRasterizedGlyphsLocked(size_t maxCount) {
+    if (!rasterizer) return 0;
+
+    rasterizedGlyphs.clear();
+    rasterizer->collect(rasterizedGlyphs, maxCount);
+    if (!rasterizedGlyphs.empty()) {
+        memoryChanged = true;
+    }
+
+    size_t placed = 0;
+    for (auto& result : rasterizedGlyphs) {
+        pendingGlyphs.erase(result.codepoint);
+
+        LazyGlyphProps* entry = glyphs.find(result.codepoint);
+        if (!entry || entry->hasBitmap) continue;
+        if (!result.found) {
+            ofLogWarning("ofxTrueTypeFontLowRAM") << "Failed to rasterize glyph: " << result.codepoint;
+            missingGlyphs.insert(result.codepoint);
+            continue;
+        }
+
+        if (sharedStore) {
+            sharedStore->publish(result.codepoint, result.props, result.pixels);
+        }
+
+        // 配置に失敗した（予算超過など）ものはメトリクスのまま残り、メモリが空いた後に使われた時に依頼し直す
+        LazyGlyphProps props = result.props;
+        if (!placeGlyph(result.codepoint, result.pixels, props)) continue;
+        props.lastUsedFrame = entry->lastUsedFrame;
+        setPlacement(*entry, props);
+        placed++;
+    }
+    rasterizedGlyphs.clear();
+
+    // メトリクスだけで組んだレイアウトを作り直させる
+    if (placed > 0) {
+        layoutGeneration++;
+    }
+    return placed;
+}
+
+size_t FontAtlasManager::preloadGlyphs(const vector<uint32_t>& codepoints) {
+    if (!ensureFace()) return 0;
+
+    // ロード済み・存在しない・重複を除く
+    vector<uint32_t> requested;
+    unordered_set<uint32_t> seen;
+    {
+        shared_lock<shared_mutex> lock(glyphMutex);
+        for (auto c : codepoints) {
+            const LazyGlyphProps* found = glyphs.find(c);
+            if (found && found->hasBitmap) continue;
+            if (missingGlyphs.count(c) || isRefused(c) || !seen.insert(c).second) continue;
+            requested.push_back(c);
+        }
+    }
+    if (requested.empty()) return 0;
+
+    // 他のプロセスがラスタライズ済みのものはコピーする
+    vector<RasterizedGlyph> results;
+    if (sharedStore) {
+        vector<uint32_t> remaining;
+        for (auto c : requested) {
+            RasterizedGlyph result;
+            result.codepoint = c;
+            if (sharedStore->find(c, result.props, result.pixels)) {
+                result.found = true;
+                sharedStoreHits++;
+                results.push_back(std::move(result));
+            } else {
+                remaining.push_back(c);
+            }
+        }
+        requested.swap(remaining);
+    }
+    size_t sharedCount = results.size();
+
+    // 残りは並列にラスタライズ（非同期用のワーカーとは別に、この呼び出しの間だけ起動する）
+    // ワーカーは自分のフェイスを使うので、待っている間もロックは持たない（他のスレッドの計測を止めない）
+    GlyphRasterizer preloader;
+    bool rasterized = requested.empty();
+    if (!rasterized && preloader.start(fontFilePath, fontSize, dpi, antialiased, atlasFormat, options.rasterizerThreads)) {
+        preloader.request(requested);
+        preloader.waitUntilIdle();
+        preloader.collect(results);
+        for (size_t i = sharedCount; sharedStore && i < results.size(); i++) {
+            if (results[i].found) {
+                sharedStore->publish(results[i].codepoint, results[i].props, results[i].pixels);
+            }
+        }
+        rasterized = true;
+    }
+
+    WriteLock lock(*this);
+    memoryChanged = true;
+    if (!rasterized) {
+        // rasterizeGlyphは共有ストアへの書き込みも行う
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "preloadGlyphs(): rasterizing on the calling thread";
+        for (auto c : requested) {
+            RasterizedGlyph result;
+            result.codepoint = c;
+            result.found = rasterizeGlyph(c, result.pixels, result.props);
+            results.push_back(std::move(result));
+        }
+    }
+
+    // 背の高い順に配置すると詰まりが良い
+    sort(results.begin(), results.end(), [](const RasterizedGlyph& a, const RasterizedGlyph& b) {
+        if (a.props.tH != b.props.tH) return a.props.tH > b.props.tH;
+        return a.props.tW > b.props.tW;
+    });
+
+    size_t placed = 0;
+    for (auto& result : results) {
+        if (!result.found) {
+            missingGlyphs.insert(result.codepoint);
+            continue;
+        }
+
+        // ロックを離している間に描画で配置されていれば、今回のものは使わない
+        LazyGlyphProps* entry = glyphs.find(result.codepoint);
+        if (entry && entry->hasBitmap) continue;
+
+        LazyGlyphProps props = result.props;
+        if (!placeGlyph(result.codepoint, result.pixels, props)) continue;
+        props.lastUsedFrame = currentFrame;
+
+        // メトリクスだけ読んであった場合は同じ場所を更新する（ポインタを変えない）
+        if (entry) {
+            setPlacement(*entry, props);
+        } else {
+            glyphs.insert(result.codepoint, props);
+        }
+        placed++;
+    }
+
+    // メトリクスだけで組んであったレイアウトを作り直させる
+    if (placed > 0) {
+        layoutGeneration++;
+    }
+    return placed;
+}
+
+const LazyGlyphProps* FontAtlasManager::getGlyphMetrics(uint32_t codepoint) {
+    // 読み込み済みなら共有ロックだけで返す（複数のスレッドから同時に計測できる）
+    {
+        shared_lock<shared_mutex> lock(glyphMutex);
+        if (const LazyGlyphProps* found = glyphs.find(codepoint)) {
+            return found;
+        }
+        if (missingGlyphs.count(codepoint)) {
+            missingLookupCount++;
+            return nullptr;
+        }
+    }
+
+    // 他のスレッドが先に読み込んでいるかもしれないので、排他ロックを取ってからもう一度探す
+    WriteLock lock(*this);
+    if (const LazyGlyphProps* found = glyphs.find(codepoint)) {
+        return found;
+    }
+    if (missingGlyphs.count(codepoint)) {
+        missingLookupCount++;
+        return nullptr;
+    }
+
+    memoryChanged = true;
+    LazyGlyphProps props;
+    if (!loadGlyphMetrics(codepoint, props)) {
+        missingLookupCount++;
+        return nullptr;
+    }
+    props.lastUsedFrame = 0;
+    return &glyphs.insert(codepoint, props);
+}
+
+bool FontAtlasManager::hasGlyph(uint32_t codepoint) const {
+    shared_lock<shared_mutex> lock(glyphMutex);
+    return glyphs.find(codepoint) != nullptr;
+}
+
+bool FontAtlasManager::isMissingGlyph(uint32_t codepoint) const {
+    shared_lock<shared_mutex> lock(glyphMutex);
+    return missingGlyphs.count(codepoint) > 0;
+}
+
+size_t FontAtlasManager::getMissingGlyphCount() const {
+    shared_lock<shared_mutex> lock(glyphMutex);
+    return missingGlyphs.size();
+}
+
+size_t FontAtlasManager::getLoadedGlyphCount() const {
+    shared_lock<shared_mutex> lock(glyphMutex);
+    return glyphs.size();
+}
+
+const ofTexture& FontAtlasManager::getTexture(size_t atlasIndex) const {
+    static ofTexture emptyTex;
+    if (atlasIndex < atlases.size()) {
+        return atlases[atlasIndex];
+    }
+    return emptyTex;
+}
+
+void FontAtlasManager::refreshMemoryUsage() const {
+    if (!memoryChanged) return;
+    memoryChanged = false;
+    memoryUsage = computeMemoryUsage();
+}
+
+size_t FontAtlasManager::computeMemoryUsage() const {
+    size_t total = 0;
+
+    // テクスチャメモリ（GPU + CPUコピー）
+    for (size_t i = 0; i < atlasStates.size(); i++) {
+        // GRAY_ALPHA = 2バイト/ピクセル、GRAY(R8) = 1バイト/ピクセル
+        size_t texSize = size_t(atlasStates[i].width) * atlasStates[i].height * getBytesPerPixel();
+        total += options.keepCpuPixels ? texSize * 2 : texSize;  // GPU (+ CPU)
+    }
+
+    // 転送待ちのグリフ
+    for (const auto& upload : pendingUploads) {
+        total += upload.pixels.getTotalBytes();
+    }
+
+    // グリフ情報
+    total += glyphs.getMemoryUsage();
+
+    // 存在しない文字の記録
+    total += missingGlyphs.size() * (sizeof(uint32_t) + 2 * sizeof(void*));
+
+    // カーニングキャッシュ（キー + 値 + ノードのおおよその大きさ）
+    total += kerningCache.size() * (sizeof(uint64_t) + sizeof(float) + 2 * sizeof(void*));
+
+    return total;
+}
+
+float FontAtlasManager::getFillRatio() const {
+    shared_lock<shared_mutex> lock(glyphMutex);
+    double used = 0;
+    double area = 0;
+    for (const auto& state : atlasStates) {
+        used += state.packer->getUsedArea();
+        area += double(state.width) * state.height;
+    }
+    return area > 0 ? float(used / area) : 0.0f;
+}
+
+double FontAtlasManager::getKerning(uint32_t leftC, uint32_t rightC) const {
+    if (!faceOpened || !kerningAvailable) return 0.0;
+    return getKerningByIndex(getGlyphIndex(leftC), getGlyphIndex(rightC));
+}
+
+float FontAtlasManager::getKerningByIndex(uint32_t leftIndex, uint32_t rightIndex) const {
+    if (!faceOpened || !kerningAvailable || leftIndex == 0 || rightIndex == 0) return 0.0f;
+
+    uint64_t key = (uint64_t(leftIndex) << 32) | rightIndex;
+    {
+        shared_lock<shared_mutex> lock(glyphMutex);
+        auto it = kerningCache.find(key);
+        if (it != kerningCache.end()) {
+            return it->second;
+        }
+    }
+
+    WriteLock lock(*this);
+    auto it = kerningCache.find(key);
+    if (it != kerningCache.end()) {
+        return it->second;
+    }
+
+    FT_Vector kerning;
+    float value = 0.0f;
+    {
+        lock_guard<mutex> faceLock(*faceMutex);
+        activateSize();
+        if (FT_Get_Kerning(face.get(), leftIndex, rightIndex, FT_KERNING_UNFITTED, &kerning) == 0) {
+            value = int26p6_to_dbl(kerning.x);
+        }
+    }
+    kerningCache.emplace(key, value);
+    memoryChanged = true;
+    return value;
+}
+
+uint32_t FontAtlasManager::getGlyphIndex(uint32_t codepoint) const {
+    if (!ensureFace()) return 0;
+    if (codepoint == ' ') return spaceGlyphIndex;
+    if (codepoint == '\t') return tabGlyphIndex;
+
+    {
+        shared_lock<shared_mutex> lock(glyphMutex);
+        if (const LazyGlyphProps* found = glyphs.find(codepoint)) {
+            return found->glyphIndex;
+        }
+        if (missingGlyphs.count(codepoint)) {
+            return 0;
+        }
+    }
+    lock_guard<mutex> faceLock(*faceMutex);
+    return FT_Get_Char_Index(face.get(), codepoint);
+}
+
+// ===========================================================================
+// アトラスのディスクキャッシュ
+// ===========================================================================
+
+// ファイル形式（リトルエンディアン、同じビルド同士での読み書きを前提とする）
+//   ヘッダ: magic, version, sizeof(CachedGlyphProps), フォントのハッシュ, サイズ, dpi, AA, フォーマット, パッカー, ボーダー
+//   アトラス数 × { 幅, 高さ, グリフ数, パッカーの状態, 跡地, ピクセル }
+//   グリフ数 × { 文字, CachedGlyphProps }
+//   存在しない文字の数 × 文字
+static const char atlasCacheMagic[8] = {'O', 'F', 'X', 'T', 'T', 'F', 'A', 'C'};
+static const uint32_t atlasCacheVersion = 3;
+
+// ファイルに書くグリフ情報
+// LazyGlyphPropsはatomicを含み、パディングもあるのでそのままは書かない。全て4バイトの値にしてパディングをなくす
+struct CachedGlyphProps {
+    uint32_t glyphIndex;
+    uint32_t atlasIndex;
+    float t1, t2, v1, v2;
+    float width, height;
+    float bearingX, bearingY;
+    float xmin, xmax, ymin, ymax;
+    float advance;
+    float tW, tH;
+    int32_t atlasX, atlasY, atlasW, atlasH;
+    uint32_t hasBitmap;
+
+    static CachedGlyphProps from(const LazyGlyphProps& props) {
+        return {props.glyphIndex, uint32_t(props.atlasIndex),
+                props.t1, props.t2, props.v1, props.v2,
+                props.width, props.height, props.bearingX, props.bearingY,
+                props.xmin, props.xmax, props.ymin, props.ymax, props.advance, props.tW, props.tH,
+                props.atlasX, props.atlasY, props.atlasW, props.atlasH, uint32_t(props.hasBitmap)};
+    }
+
+    LazyGlyphProps toProps() const {
+        LazyGlyphProps props;
+        props.glyphIndex = glyphIndex;
+        props.atlasIndex = atlasIndex;
+        props.t1 = t1;
+        props.t2 = t2;
+        props.v1 = v1;
+        props.v2 = v2;
+        props.width = width;
+        props.height = height;
+        props.bearingX = bearingX;
+        props.bearingY = bearingY;
+        props.xmin = xmin;
+        props.xmax = xmax;
+        props.ymin = ymin;
+        props.ymax = ymax;
+        props.advance = advance;
+        props.tW = tW;
+        props.tH = tH;
+        props.atlasX = atlasX;
+        props.atlasY = atlasY;
+        props.atlasW = atlasW;
+        props.atlasH = atlasH;
+        props.lastUsedFrame = 0;
+        props.hasBitmap = hasBitmap != 0;
+        return props;
+    }
+};
+static_assert(std::is_trivially_copyable_v<CachedGlyphProps>, "CachedGlyphProps is written as raw bytes");
+static_assert(sizeof(CachedGlyphProps) == 22 * 4, "CachedGlyphProps must not have padding");
+
+template<typename T>
+static void writeValue(ofstream& out, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>, "only plain values can be written as raw bytes");
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static void writeArray(ofstream& out, const T* values, size_t count) {
+    writeValue(out, uint32_t(count));
+    out.write(reinterpret_cast<const char*>(values), sizeof(T) * count);
+}
+
+// mmapしたキャッシュファイルの読み出し（範囲外を読もうとしたら以降はすべて失敗）
+class AtlasCacheReader {
+public:
+    AtlasCacheReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    template<typename T>
+    bool read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain values can be read as raw bytes");
+        return readBytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    bool readArray(vector<T>& values) {
+        uint32_t count = 0;
+        if (!read(count) || size_t(count) * sizeof(T) > size - offset) return fail();
+        values.resize(count);
+        return readBytes(values.data(), sizeof(T) * count);
+    }
+
+    // コピーせずに指定バイト数を参照する
+    const uint8_t* view(size_t bytes) {
+        if (!ok || bytes > size - offset) {
+            fail();
+            return nullptr;
+        }
+        const uint8_t* p = data + offset;
+        offset += bytes;
+        return p;
+    }
+
+    bool isOk() const { return ok; }
+
+private:
+    bool readBytes(void* dst, size_t bytes) {
+        const uint8_t* p = view(bytes);
+        if (!p) return false;
+        memcpy(dst, p, bytes);
+        return true;
+    }
+    bool fail() {
+        ok = false;
+        return false;
+    }
+
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+    bool ok = true;
+};
+
+string FontAtlasManager::getCacheFileName(const string& extension) const {
+    char hashText[17];
+    snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(fontFileHash));
+    return fontFilePath.stem().string() + "-" + ofToString(fontSize) + (antialiased ? "-aa-" : "-mono-") +
+           ofToString(dpi) + (atlasFormat == OF_PIXELS_GRAY ? "-r8-" : "-") + hashText + extension;
+}
+
+of::filesystem::path FontAtlasManager::getAtlasCachePath() const {
+    if (options.atlasCacheDirectory.empty()) return of::filesystem::path();
+    return of::filesystem::path(ofToDataPath(options.atlasCacheDirectory, true)) / getCacheFileName(".atlas");
+}
+
+bool FontAtlasManager::saveAtlasCache() {
+    if (options.atlasCacheDirectory.empty()) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "saveAtlasCache(): atlasCacheDirectory is not set";
+        return false;
+    }
+
+    // CPU側コピーがなければテクスチャから読み戻す（flushUploadsはロックを取るので、ロックはその後で取る）
+    vector<ofPixels> readback;
+    if (!options.keepCpuPixels) {
+#ifdef TARGET_OPENGLES
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "saveAtlasCache(): requires keepCpuPixels on GLES";
+        return false;
+#else
+        flushUploads();
+        readback.resize(atlases.size());
+        for (size_t i = 0; i < atlases.size(); i++) {
+            if (atlases[i].isAllocated()) {
+                atlases[i].readToPixels(readback[i]);
+            }
+            if (readback[i].getNumChannels() != getBytesPerPixel()) {
+                ofLogError("ofxTrueTypeFontLowRAM") << "saveAtlasCache(): failed to read back atlas " << i;
+                return false;
+            }
+        }
+#endif
+    }
+
+    WriteLock lock(*this);
+    if (fontFileHash == 0) {
+        fontFileHash = hashFontFile(fontFilePath);
+    }
+
+    of::filesystem::path path = getAtlasCachePath();
+    error_code ec;
+    of::filesystem::create_directories(path.parent_path(), ec);
+
+    // 書きかけのファイルを読まれないよう、別名で書いてから置き換える
+    of::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+    ofstream out(tmpPath.string(), ios::binary | ios::trunc);
+    if (!out) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "saveAtlasCache(): failed to open " << tmpPath;
+        return false;
+    }
+
+    out.write(atlasCacheMagic, sizeof(atlasCacheMagic));
+    writeValue(out, atlasCacheVersion);
+    writeValue(out, uint32_t(sizeof(CachedGlyphProps)));
+    writeValue(out, fontFileHash);
+    writeValue(out, int32_t(fontSize));
+    writeValue(out, int32_t(dpi));
+    writeValue(out, uint8_t(antialiased));
+    writeValue(out, uint8_t(atlasFormat == OF_PIXELS_GRAY));
+    writeValue(out, uint8_t(options.packer));
+    writeValue(out, int32_t(border));
+
+    writeValue(out, uint32_t(atlasStates.size()));
+    vector<int64_t> packerState;
+    for (size_t i = 0; i < atlasStates.size(); i++) {
+        const AtlasState& state = atlasStates[i];
+        writeValue(out, int32_t(state.width));
+        writeValue(out, int32_t(state.height));
+        writeValue(out, uint64_t(state.glyphCount));
+        state.packer->saveState(packerState);
+        writeArray(out, packerState.data(), packerState.size());
+        writeArray(out, state.freeRects.data(), state.freeRects.size());
+        const ofPixels& pixels = options.keepCpuPixels ? atlasPixels[i] : readback[i];
+        out.write(reinterpret_cast<const char*>(pixels.getData()),
+                  size_t(state.width) * state.height * getBytesPerPixel());
+    }
+
+    writeValue(out, uint32_t(glyphs.size()));
+    glyphs.forEach([&](uint32_t codepoint, const LazyGlyphProps& props) {
+        writeValue(out, codepoint);
+        writeValue(out, CachedGlyphProps::from(props));
+    });
+
+    vector<uint32_t> missing(missingGlyphs.begin(), missingGlyphs.end());
+    writeArray(out, missing.data(), missing.size());
+
+    out.close();
+    if (!out) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "saveAtlasCache(): failed to write " << tmpPath;
+        of::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    of::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "saveAtlasCache(): failed to replace " << path << ": " << ec.message();
+        return false;
+    }
+
+    ofLogVerbose("ofxTrueTypeFontLowRAM") << "Saved atlas cache: " << path << " (" << glyphs.size() << " glyphs)";
+    return true;
+}
+
+bool FontAtlasManager::loadAtlasCache() {
+    of::filesystem::path path = getAtlasCachePath();
+    error_code ec;
+    if (fontFileHash == 0 || !of::filesystem::exists(path, ec)) return false;
+
+    MappedFile file;
+    if (!file.open(path)) return false;
+    AtlasCacheReader in(file.data(), file.size());
+
+    // 設定が1つでも違えば使わない（フォントが更新された場合はハッシュが変わる）
+    char magic[sizeof(atlasCacheMagic)];
+    uint32_t version = 0, propsSize = 0;
+    uint64_t hash = 0;
+    int32_t cachedSize = 0, cachedDpi = 0, cachedBorder = 0;
+    uint8_t cachedAntialiased = 0, cachedSingleChannel = 0, cachedPacker = 0;
+    in.read(magic);
+    in.read(version);
+    in.read(propsSize);
+    in.read(hash);
+    in.read(cachedSize);
+    in.read(cachedDpi);
+    in.read(cachedAntialiased);
+    in.read(cachedSingleChannel);
+    in.read(cachedPacker);
+    in.read(cachedBorder);
+    if (!in.isOk() || memcmp(magic, atlasCacheMagic, sizeof(magic)) != 0 || version != atlasCacheVersion ||
+        propsSize != sizeof(CachedGlyphProps) || hash != fontFileHash || cachedSize != fontSize ||
+        cachedDpi != dpi || bool(cachedAntialiased) != antialiased ||
+        bool(cachedSingleChannel) != (atlasFormat == OF_PIXELS_GRAY) ||
+        cachedPacker != uint8_t(options.packer) || cachedBorder != border) {
+        ofLogVerbose("ofxTrueTypeFontLowRAM") << "Atlas cache does not match, ignored: " << path;
+        return false;
+    }
+
+    // アトラスの大きさを最大テクスチャサイズと比べるので、ここで取得しておく（キャッシュの読み込みはGLが前提）
+    if (!maxAtlasSizeQueried) {
+        maxAtlasSize = getMaxTextureSize();
+        maxAtlasSizeQueried = true;
+    }
+
+    // 一旦すべて読んでから入れ替える（途中で壊れていたら何も変えない）
+    uint32_t atlasCount = 0;
+    in.read(atlasCount);
+    vector<AtlasState> states;
+    vector<ofPixels> pixels;
+    size_t totalBytes = 0;
+    vector<int64_t> packerState;
+    for (uint32_t i = 0; i < atlasCount && in.isOk(); i++) {
+        AtlasState state;
+        int32_t width = 0, height = 0;
+        uint64_t glyphCount = 0;
+        in.read(width);
+        in.read(height);
+        in.read(glyphCount);
+        in.readArray(packerState);
+        in.readArray(state.freeRects);
+        if (!in.isOk() || width <= 0 || height <= 0 || width > maxAtlasSize || height > maxAtlasSize) break;
+
+        // 配置の状態と跡地がアトラスの中に収まっているか
+        state.width = width;
+        state.height = height;
+        state.glyphCount = size_t(glyphCount);
+        state.packer = GlyphPacker::create(options.packer);
+        if (!state.packer->loadState(packerState) || state.packer->getWidth() != width ||
+            state.packer->getHeight() != height) {
+            break;
+        }
+        bool rectsInside = all_of(state.freeRects.begin(), state.freeRects.end(), [&](const FreeRect& r) {
+            return r.x >= 0 && r.y >= 0 && r.w > 0 && r.h > 0 && r.x <= width - r.w && r.y <= height - r.h;
+        });
+        if (!rectsInside) break;
+
+        const uint8_t* data = in.view(size_t(width) * height * getBytesPerPixel());
+        if (!data) break;
+        ofPixels atlas;
+        atlas.setFromPixels(data, width, height, atlasFormat);
+        pixels.push_back(std::move(atlas));
+        states.push_back(std::move(state));
+        totalBytes += getAtlasBytes(width);
+    }
+
+    // 配置済みのグリフはアトラスの中にあり、アトラスごとの数が保存されたグリフ数と一致すること
+    uint32_t glyphCount = 0;
+    in.read(glyphCount);
+    vector<pair<uint32_t, LazyGlyphProps>> entries;
+    vector<size_t> placedCounts(states.size(), 0);
+    bool glyphsInside = true;
+    for (uint32_t i = 0; i < glyphCount && in.isOk() && glyphsInside; i++) {
+        uint32_t codepoint = 0;
+        CachedGlyphProps cached;
+        if (!in.read(codepoint) || !in.read(cached)) break;
+        if (cached.hasBitmap && (cached.atlasW != 0 || cached.atlasH != 0)) {
+            glyphsInside = cached.atlasIndex < states.size() && cached.atlasW > 0 && cached.atlasH > 0 &&
+                           cached.atlasX >= 0 && cached.atlasY >= 0 &&
+                           cached.atlasX <= states[cached.atlasIndex].width - cached.atlasW &&
+                           cached.atlasY <= states[cached.atlasIndex].height - cached.atlasH;
+            if (glyphsInside) placedCounts[cached.atlasIndex]++;
+        }
+        entries.emplace_back(codepoint, cached.toProps());
+    }
+    for (size_t i = 0; i < states.size() && glyphsInside; i++) {
+        glyphsInside = placedCounts[i] == states[i].glyphCount;
+    }
+    vector<uint32_t> missing;
+    in.readArray(missing);
+
+    if (!in.isOk() || states.size() != atlasCount || entries.size() != glyphCount || !glyphsInside) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "Atlas cache is corrupted, ignored: " << path;
+        return false;
+    }
+    if (options.memoryBudget > 0 && totalBytes > options.memoryBudget) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "Atlas cache exceeds the memory budget, ignored: " << path;
+        return false;
+    }
+
+    atlasStates = std::move(states);
+    atlases.clear();
+    atlases.resize(atlasStates.size());
+    atlasPixels.clear();
+    pendingUploads.clear();
+    for (size_t i = 0; i < pixels.size(); i++) {
+        if (options.keepCpuPixels) {
+            atlasPixels.push_back(std::move(pixels[i]));
+        } else {
+            // CPU側に残さず、最初のflushUploadsで転送して捨てる
+            atlasPixels.push_back(ofPixels());
+            pendingUploads.push_back({i, 0, 0, std::move(pixels[i])});
+        }
+    }
+
+    glyphs.clear();
+    for (auto& [codepoint, props] : entries) {
+        glyphs.insert(codepoint, props);
+    }
+    missingGlyphs.clear();
+    missingGlyphs.insert(missing.begin(), missing.end());
+
+    ofLogNotice("ofxTrueTypeFontLowRAM") << "Loaded atlas cache: " << path << " (" << glyphs.size() << " glyphs, "
+                                         << atlasStates.size() << " atlas(es))";
+    return true;
+}
+
+// ===========================================================================
+// グリフの使用状況の記録
+// ===========================================================================
+
+// テキスト形式: 1行目がヘッダ、以降は「文字 フレーム数 順番」をよく使われた順に
+static const char* usageProfileHeader = "# ofxTrueTypeFontLowRAM usage profile 1";
+
+of::filesystem::path FontAtlasManager::getUsageProfilePath() const {
+    if (options.usageProfileDirectory.empty()) return of::filesystem::path();
+    // 内容のハッシュは含めないので、フォントファイルを更新しても記録は引き継がれる
+    string name = fontFilePath.stem().string() + "-" + ofToString(fontSize) + "-" + ofToString(dpi) + ".usage";
+    return of::filesystem::path(ofToDataPath(options.usageProfileDirectory, true)) / name;
+}
+
+void FontAtlasManager::loadUsageProfile() {
+    of::filesystem::path path = getUsageProfilePath();
+    ifstream in(path.string());
+    if (!in) return;
+
+    string line;
+    if (!getline(in, line) || line != usageProfileHeader) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "Unknown usage profile format, ignored: " << path;
+        return;
+    }
+
+    // 前回までの回数は半分にして、最近の内容ほど重くする
+    uint32_t codepoint, frames, order;
+    while (in >> codepoint >> frames >> order) {
+        GlyphUsage entry;
+        entry.frames = (frames + 1) / 2;
+        entry.order = order;
+        usage.insert(codepoint, entry);
+        nextUsageOrder = max(nextUsageOrder, order + 1);
+    }
+    ofLogVerbose("ofxTrueTypeFontLowRAM") << "Loaded usage profile: " << path << " (" << usage.size() << " glyphs)";
+}
+
+// よく使われた順（同じなら最初に使われた順）に並べた文字
+static vector<uint32_t> sortByUsage(vector<pair<uint32_t, pair<uint32_t, uint32_t>>>& entries) {
+    sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+        if (a.second.first != b.second.first) return a.second.first > b.second.first;
+        return a.second.second < b.second.second;
+    });
+    vector<uint32_t> codepoints;
+    codepoints.reserve(entries.size());
+    for (const auto& entry : entries) codepoints.push_back(entry.first);
+    return codepoints;
+}
+
+bool FontAtlasManager::saveUsageProfile() const {
+    of::filesystem::path path = getUsageProfilePath();
+    if (path.empty()) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "saveUsageProfile(): usageProfileDirectory is not set";
+        return false;
+    }
+
+    shared_lock<shared_mutex> lock(glyphMutex);
+    vector<pair<uint32_t, pair<uint32_t, uint32_t>>> entries;
+    usage.forEach([&](uint32_t codepoint, const GlyphUsage& entry) {
+        if (entry.frames > 0 && !missingGlyphs.count(codepoint)) {
+            entries.push_back({codepoint, {entry.frames, entry.order}});
+        }
+    });
+    vector<uint32_t> codepoints = sortByUsage(entries);
+
+    error_code ec;
+    of::filesystem::create_directories(path.parent_path(), ec);
+    ofstream out(path.string(), ios::trunc);
+    if (!out) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "saveUsageProfile(): failed to open " << path;
+        return false;
+    }
+    out << usageProfileHeader << "\n";
+    for (uint32_t codepoint : codepoints) {
+        const GlyphUsage* entry = usage.find(codepoint);
+        out << codepoint << " " << entry->frames << " " << entry->order << "\n";
+    }
+    return bool(out);
+}
+
+size_t FontAtlasManager::prewarmFromUsageProfile(size_t maxGlyphs) {
+    vector<pair<uint32_t, pair<uint32_t, uint32_t>>> entries;
+    {
+        shared_lock<shared_mutex> lock(glyphMutex);
+        usage.forEach([&](uint32_t codepoint, const GlyphUsage& entry) {
+            if (entry.frames > 0) {
+                entries.push_back({codepoint, {entry.frames, entry.order}});
+            }
+        });
+    }
+    if (entries.empty()) return 0;
+
+    vector<uint32_t> codepoints = sortByUsage(entries);
+    if (maxGlyphs > 0 && codepoints.size() > maxGlyphs) {
+        codepoints.resize(maxGlyphs);
+    }
+    size_t placed = preloadGlyphs(codepoints);
+    ofLogVerbose("ofxTrueTypeFontLowRAM") << "Prewarmed " << placed << " glyphs from usage profile";
+    return placed;
+}
+
+void FontAtlasManager::openSharedGlyphStore() {
+    if (fontFileHash == 0) return;
+
+    SharedGlyphStore::Key key;
+    key.fontHash = fontFileHash;
+    key.fontSize = fontSize;
+    key.dpi = dpi;
+    key.antialiased = antialiased;
+    key.format = atlasFormat;
+
+    of::filesystem::path path =
+        of::filesystem::path(ofToDataPath(options.sharedGlyphStoreDirectory, true)) / getCacheFileName(".glyphs");
+    auto store = make_unique<SharedGlyphStore>();
+    if (!store->open(path, key, options.sharedGlyphStoreSize)) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "Shared glyph store disabled for " << fontFilePath;
+        return;
+    }
+    ofLogVerbose("ofxTrueTypeFontLowRAM") << "Opened shared glyph store: " << path << " ("
+                                          << store->getGlyphCount() << " glyphs)";
+    sharedStore = std::move(store);
+}
+
+// ===========================================================================
+// FontFacePool 実装
+// ===========================================================================
+
+FontFacePool& FontFacePool::getInstance() {
+    static FontFacePool instance;
+    return instance;
+}
+
+shared_ptr<FT_FaceRec_> FontFacePool::acquire(const of::filesystem::path& resolvedPath, bool memoryMap) {
+    lock_guard<mutex> lock(poolMutex);
+    string key = resolvedPath.string();
+    auto it = faces.find(key);
+    if (it != faces.end()) {
+        if (auto existing = it->second.face.lock()) {
+            return existing;
+        }
+    }
+
+    FT_Face rawFace;
+    shared_ptr<MappedFile> file;
+    if (memoryMap) {
+        file = make_shared<MappedFile>();
+        if (!file->open(resolvedPath)) {
+            return nullptr;
+        }
+    }
+    {
+        lock_guard<mutex> libraryLock(ftLibraryMutex);
+        FT_Error err = file ? FT_New_Memory_Face(ftLibrary, file->data(), FT_Long(file->size()), 0, &rawFace)
+                            : FT_New_Face(ftLibrary, key.c_str(), 0, &rawFace);
+        if (err) {
+            return nullptr;
+        }
+    }
+
+    // 注意: プログラム終了時、static変数の破棄順序が不定のため
+    // ftLibraryがnullptrの場合はFT_Done_Faceを呼ばない
+    // マップしたファイルはフェイスを閉じた後に解放する
+    // （デリータ自体はweak_ptrが残っている間破棄されないので、ここで明示的に手放す）
+    shared_ptr<FT_FaceRec_> face(rawFace, [file](FT_Face f) mutable {
+        if (ftLibrary != nullptr) {
+            lock_guard<mutex> libraryLock(ftLibraryMutex);
+            FT_Done_Face(f);
+        }
+        file.reset();
+    });
+    Entry& entry = faces[key];
+    entry.face = face;
+    entry.file = file;
+    ofLogVerbose("ofxTrueTypeFontLowRAM") << "Opened face: " << key << (memoryMap ? " (mapped)" : "");
+    return face;
+}
+
+shared_ptr<mutex> FontFacePool::getFaceMutex(const of::filesystem::path& resolvedPath) {
+    lock_guard<mutex> lock(poolMutex);
+    // 閉じて開き直したフェイスでも同じロックを使う
+    auto& faceMutex = faces[resolvedPath.string()].faceMutex;
+    if (!faceMutex) {
+        faceMutex = make_shared<mutex>();
+    }
+    return faceMutex;
+}
+
+size_t FontFacePool::getFaceCount() const {
+    lock_guard<mutex> lock(poolMutex);
+    size_t count = 0;
+    for (const auto& entry : faces) {
+        if (!entry.second.face.expired()) count++;
+    }
+    return count;
+}
+
+size_t FontFacePool::getMappedBytes() const {
+    lock_guard<mutex> lock(poolMutex);
+    size_t total = 0;
+    for (const auto& entry : faces) {
+        if (auto file = entry.second.file.lock()) total += file->size();
+    }
+    return total;
+}
+
+size_t FontFacePool::getResidentBytes() const {
+    lock_guard<mutex> lock(poolMutex);
+    size_t total = 0;
+    for (const auto& entry : faces) {
+        if (auto file = entry.second.file.lock()) total += file->getResidentBytes();
+    }
+    return total;
+}
+
+// ===========================================================================
+// SharedFontCache 実装
+// ===========================================================================
+
+SharedFontCache& SharedFontCache::getInstance() {
+    static SharedFontCache instance;
+    return instance;
+}
+
+shared_ptr<FontAtlasManager> SharedFontCache::getOrCreate(const FontCacheKey& key, int dpi) {
+    FontAtlasOptions options;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            return it->second;
+        }
+        options = defaultOptions;
+    }
+
+    // ファイルのハッシュなど時間のかかる準備はロックの外で行う
+    auto manager = make_shared<FontAtlasManager>();
+    if (!manager->setup(key.fontPath, key.fontSize, key.antialiased, dpi, options)) {
+        return nullptr;
+    }
+    manager->setGrowthGuard([this](FontAtlasManager& requester, size_t additionalBytes, bool reclaim) {
+        return reserve(requester, additionalBytes, reclaim);
+    });
+
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        // 他のスレッドが先に同じフォントを作っていればそちらを使う
+        auto inserted = cache.emplace(key, manager);
+        if (!inserted.second) {
+            return inserted.first->second;
+        }
+    }
+
+    // 前回の使用状況があれば先読みする（予算の判定を通すため、登録してから）
+    // アトラスへの配置はGLが必要なので、ワーカースレッドでロードした時は行わない
+    if (!options.usageProfileDirectory.empty() && !options.deferFaceLoad) {
+        if (ofThread::isMainThread()) {
+            manager->prewarmFromUsageProfile(options.usageProfilePrewarmLimit);
+        } else {
+            ofLogVerbose("ofxTrueTypeFontLowRAM") << "Skipped usage profile prewarm off the main thread: " << key.fontPath;
+        }
+    }
+    return manager;
+}
+
+vector<shared_ptr<FontAtlasManager>> SharedFontCache::getManagers() const {
+    lock_guard<mutex> lock(cacheMutex);
+    vector<shared_ptr<FontAtlasManager>> managers;
+    managers.reserve(cache.size());
+    for (const auto& entry : cache) {
+        managers.push_back(entry.second);
+    }
+    return managers;
+}
+
+size_t SharedFontCache::openDeferredFaces(size_t maxCount) {
+    size_t opened = 0;
+    for (auto& manager : getManagers()) {
+        if (opened >= maxCount) break;
+        if (!manager->isFaceOpen() && manager->ensureFace()) {
+            opened++;
+        }
+    }
+    return opened;
+}
+
+size_t SharedFontCache::saveUsageProfiles() {
+    size_t saved = 0;
+    for (auto& manager : getManagers()) {
+        if (!manager->getUsageProfilePath().empty() && manager->saveUsageProfile()) {
+            saved++;
+        }
+    }
+    return saved;
+}
+
+size_t SharedFontCache::saveAtlasCaches() {
+    size_t saved = 0;
+    for (auto& manager : getManagers()) {
+        if (!manager->getAtlasCachePath().empty() && manager->saveAtlasCache()) {
+            saved++;
+        }
+    }
+    return saved;
+}
+
+void SharedFontCache::release(const FontCacheKey& key) {
+    // アトラスの破棄はロックを離してから
+    shared_ptr<FontAtlasManager> released;
+    lock_guard<mutex> lock(cacheMutex);
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        released = std::move(it->second);
+        cache.erase(it);
+        notifyMemoryFreed();
+    }
+}
+
+void SharedFontCache::clear() {
+    decltype(cache) released;
+    lock_guard<mutex> lock(cacheMutex);
+    released.swap(cache);
+    notifyMemoryFreed();
+}
+
+void SharedFontCache::setDefaultOptions(const FontAtlasOptions& options) {
+    lock_guard<mutex> lock(cacheMutex);
+    defaultOptions = options;
+}
+
+FontAtlasOptions SharedFontCache::getDefaultOptions() const {
+    lock_guard<mutex> lock(cacheMutex);
+    return defaultOptions;
+}
+
+bool SharedFontCache::reserve(FontAtlasManager& requester, size_t additionalBytes, bool reclaim) {
+    size_t budget = memoryBudget;
+    if (budget == 0) return true;
+
+    // 各アトラスのメモリ使用量はロックなしで読める値を使い、cacheMutexを持ったまま他のアトラスを待たない
+    // キャッシュから外したアトラスの破棄（GLテクスチャ・フェイスの解放）もロックを離してから行う
+    vector<shared_ptr<FontAtlasManager>> others;
+    vector<shared_ptr<FontAtlasManager>> released;
+    size_t total = 0;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        for (const auto& entry : cache) {
+            total += entry.second->getMemoryUsage();
+        }
+        if (total + additionalBytes <= budget) return true;
+        if (!reclaim) return false;
+
+        // 使われていない順に並べる（フレーム番号は並べ替えの間に変わり得るので先に読んでおく）
+        vector<pair<uint64_t, FontCacheKey>> candidates;
+        for (const auto& [key, manager] : cache) {
+            if (manager.get() != &requester) {
+                candidates.emplace_back(manager->getCurrentFrame(), key);
+            }
+        }
+        sort(candidates.begin(), candidates.end(),
+             [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        // 1. どのフォントからも参照されていないアトラスを丸ごと解放
+        for (const auto& candidate : candidates) {
+            auto it = cache.find(candidate.second);
+            if (it->second.use_count() == 1) {
+                total -= min(total, it->second->getMemoryUsage());
+                released.push_back(std::move(it->second));
+                cache.erase(it);
+                notifyMemoryFreed();
+                if (total + additionalBytes <= budget) break;
+            } else {
+                others.push_back(it->second);
+            }
+        }
+        if (total + additionalBytes <= budget) return true;
+    }
+
+    // 2. 他のアトラスから使われていないグリフを追い出し、空になったアトラスを解放
+    //    （requesterのロックを持っているので、他のスレッドが使用中のアトラスは飛ばす）
+    uint64_t now = requester.getCurrentFrame();
+    for (auto& manager : others) {
+        total -= min(total, manager->tryReclaim(now));
+        if (total + additionalBytes <= budget) return true;
+    }
+
+    return false;
+}
+
+size_t SharedFontCache::getTotalMemoryUsage() const {
+    lock_guard<mutex> lock(cacheMutex);
+    size_t total = 0;
+    for (const auto& [key, manager] : cache) {
+        total += manager->getMemoryUsage();
+    }
+    return total;
+}
+
+// ===========================================================================
+// ofxTrueTypeFontLowRAM 実装
+// ===========================================================================
+
+TextBatch* ofxTrueTypeFontLowRAM::activeBatch = nullptr;
+glm::mat4 ofxTrueTypeFontLowRAM::batchModelMatrix(1.0f);
+
+// ビュー行列を除いたモデル行列
+static glm::mat4 getCurrentModelMatrix() {
+    return glm::inverse(ofGetCurrentViewMatrix()) * ofGetCurrentMatrix(OF_MATRIX_MODELVIEW);
+}
+
+ofxTrueTypeFontLowRAM::ofxTrueTypeFontLowRAM() {
+}
+
+ofxTrueTypeFontLowRAM::~ofxTrueTypeFontLowRAM() {
+}
+
+ofxTrueTypeFontLowRAM::ofxTrueTypeFontLowRAM(const ofxTrueTypeFontLowRAM& other) {
+    atlasManager = other.atlasManager;
+    cacheKey = other.cacheKey;
+    bLoadedOk = other.bLoadedOk;
+    lineHeight = other.lineHeight;
+    ascenderHeight = other.ascenderHeight;
+    descenderHeight = other.descenderHeight;
+    letterSpacing = other.letterSpacing;
+    spaceSize = other.spaceSize;
+    metricsSynced = other.metricsSynced.load();
+}
+
+ofxTrueTypeFontLowRAM& ofxTrueTypeFontLowRAM::operator=(const ofxTrueTypeFontLowRAM& other) {
+    if (this != &other) {
+        atlasManager = other.atlasManager;
+        cacheKey = other.cacheKey;
+        bLoadedOk = other.bLoadedOk;
+        lineHeight = other.lineHeight;
+        ascenderHeight = other.ascenderHeight;
+        descenderHeight = other.descenderHeight;
+        letterSpacing = other.letterSpacing;
+        spaceSize = other.spaceSize;
+        metricsSynced = other.metricsSynced.load();
+    }
+    return *this;
+}
+
+ofxTrueTypeFontLowRAM::ofxTrueTypeFontLowRAM(ofxTrueTypeFontLowRAM&& other) noexcept {
+    atlasManager = std::move(other.atlasManager);
+    cacheKey = std::move(other.cacheKey);
+    bLoadedOk = other.bLoadedOk;
+    lineHeight = other.lineHeight;
+    ascenderHeight = other.ascenderHeight;
+    descenderHeight = other.descenderHeight;
+    letterSpacing = other.letterSpacing;
+    spaceSize = other.spaceSize;
+    metricsSynced = other.metricsSynced.load();
+    other.bLoadedOk = false;
+}
+
+ofxTrueTypeFontLowRAM& ofxTrueTypeFontLowRAM::operator=(ofxTrueTypeFontLowRAM&& other) noexcept {
+    if (this != &other) {
+        atlasManager = std::move(other.atlasManager);
+        cacheKey = std::move(other.cacheKey);
+        bLoadedOk = other.bLoadedOk;
+        lineHeight = other.lineHeight;
+        ascenderHeight = other.ascenderHeight;
+        descenderHeight = other.descenderHeight;
+        letterSpacing = other.letterSpacing;
+        spaceSize = other.spaceSize;
+        metricsSynced = other.metricsSynced.load();
+        other.bLoadedOk = false;
+    }
+    return *this;
+}
+
+bool ofxTrueTypeFontLowRAM::load(const of::filesystem::path& filename,
+                                  int fontsize,
+                                  bool _bAntiAliased,
+                                  bool _bFullCharacterSet,
+                                  bool makeContours,
+                                  float simplifyAmt,
+                                  int dpi) {
+    if (makeContours) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "makeContours is not supported";
+    }
+
+    // キャッシュキー作成
+    cacheKey.fontPath = filename.string();
+    cacheKey.fontSize = fontsize;
+    cacheKey.antialiased = _bAntiAliased;
+
+    // 共有キャッシュから取得
+    atlasManager = SharedFontCache::getInstance().getOrCreate(cacheKey, dpi);
+    if (!atlasManager) {
+        bLoadedOk = false;
+        return false;
+    }
+
+    // 親クラスのメンバーを設定
+    // （フェイスがまだ開かれていなければ、メトリクスは最初に使う時に設定する）
+    bLoadedOk = true;
+    metricsSynced = false;
+    if (atlasManager->isFaceOpen()) {
+        syncMetrics();
+    }
+    letterSpacing = 1.0f;
+    spaceSize = 1.0f;
 
     // 設定を保存
     settings.fontName = filename;
@@ -648,6 +2384,54 @@ bool ofxTrueTypeFontLowRAM::load(const of::filesystem::path& filename,
     return true;
 }
 
+void ofxTrueTypeFontLowRAM::syncMetrics() const {
+    if (metricsSynced || !atlasManager || !atlasManager->ensureFace()) return;
+
+    // 複数のスレッドから同時に計測されても書き換えは1回だけ
+    static std::mutex syncMutex;
+    lock_guard<mutex> lock(syncMutex);
+    if (metricsSynced) return;
+
+    // 親クラスのメンバーはconstな描画・計測の途中で初めて決まることがあるので、ここだけ書き換える
+    auto self = const_cast<ofxTrueTypeFontLowRAM*>(this);
+    self->lineHeight = atlasManager->getLineHeight();
+    self->ascenderHeight = atlasManager->getAscenderHeight();
+    self->descenderHeight = atlasManager->getDescenderHeight();
+    metricsSynced = true;
+}
+
+float ofxTrueTypeFontLowRAM::getLineHeight() const {
+    syncMetrics();
+    return lineHeight;
+}
+
+void ofxTrueTypeFontLowRAM::setLineHeight(float height) {
+    syncMetrics();  // 後からフェイスの値で上書きされないように先に確定させる
+    lineHeight = height;
+}
+
+float ofxTrueTypeFontLowRAM::getAscenderHeight() const {
+    syncMetrics();
+    return ascenderHeight;
+}
+
+float ofxTrueTypeFontLowRAM::getDescenderHeight() const {
+    syncMetrics();
+    return descenderHeight;
+}
+
+size_t ofxTrueTypeFontLowRAM::openDeferredFaces(size_t maxCount) {
+    return SharedFontCache::getInstance().openDeferredFaces(maxCount);
+}
+
+size_t ofxTrueTypeFontLowRAM::saveAtlasCaches() {
+    return SharedFontCache::getInstance().saveAtlasCaches();
+}
+
+size_t ofxTrueTypeFontLowRAM::saveUsageProfiles() {
+    return SharedFontCache::getInstance().saveUsageProfiles();
+}
+
 bool ofxTrueTypeFontLowRAM::load(const ofTrueTypeFontSettings& s) {
     if (!s.ranges.empty()) {
         ofLogWarning("ofxTrueTypeFontLowRAM") << "Unicode ranges are ignored. This addon uses lazy loading, so all glyphs are loaded on demand regardless of range settings.";
@@ -655,114 +2439,167 @@ bool ofxTrueTypeFontLowRAM::load(const ofTrueTypeFontSettings& s) {
     return load(s.fontName, s.fontSize, s.antialiased, true, s.contours, s.simplifyAmt, s.dpi);
 }
 
+ofxTrueTypeFontLowRAM::LayoutSettings ofxTrueTypeFontLowRAM::getLayoutSettings() const {
+    syncMetrics();
+    LayoutSettings layout;
+    layout.lineHeight = lineHeight;
+    layout.letterSpacing = letterSpacing;
+    layout.spaceSize = spaceSize;
+    layout.leftToRight = (settings.direction == OF_TTF_LEFT_TO_RIGHT);
+    return layout;
+}
+
+template<bool LoadBitmaps, typename Callback>
 void ofxTrueTypeFontLowRAM::iterateStringInternal(const string& str, float x, float y, bool vFlipped,
-                                                   function<void(uint32_t, glm::vec2)> f) const {
+                                                   Callback&& f) const {
     if (!atlasManager) return;
+    iterateString<LoadBitmaps>(*atlasManager, getLayoutSettings(), str, x, y, vFlipped, std::forward<Callback>(f));
+}
+
+template<bool LoadBitmaps, typename Callback>
+void ofxTrueTypeFontLowRAM::iterateString(FontAtlasManager& manager, const LayoutSettings& layout, const string& str,
+                                          float x, float y, bool vFlipped, Callback&& f) {
+    // 追い出し判定用に使用フレームを記録（フレームが変わるとアトラスの更新を伴うので描画時だけ）
+    // 計測はワーカースレッドからも呼ばれ、ラスタライズしないのでフレームは使わない
+    if (LoadBitmaps) {
+        manager.setCurrentFrame(ofGetFrameNum());
+    }
+
+    // ループ内で変わらない値は先に計算しておく
+    const bool leftToRight = layout.leftToRight;
+    const float directionX = leftToRight ? 1 : -1;
+    const float lineStep = layout.lineHeight * (vFlipped ? 1 : -1);
+    const float spaceStep = manager.getSpaceAdvance() * layout.spaceSize * directionX;
+    const float tabStep = spaceStep * 4;
+    const float letterStep = manager.getSpaceAdvance() * (layout.letterSpacing - 1.f) * directionX;
+    const bool useKerning = manager.hasKerning();
+    const uint32_t spaceIndex = manager.getGlyphIndex(' ');
+    const uint32_t tabIndex = manager.getGlyphIndex('\t');
 
     glm::vec2 pos(x, y);
-    float newLineDirection = vFlipped ? 1 : -1;
-    float directionX = (settings.direction == OF_TTF_LEFT_TO_RIGHT) ? 1 : -1;
-    uint32_t prevC = 0;
+    uint32_t prevIndex = 0;  // 直前の文字のグリフインデックス（0なら改行直後）
 
     for (auto c : ofUTF8Iterator(str)) {
-        try {
-            if (c == '\n') {
-                pos.y += lineHeight * newLineDirection;
-                pos.x = x;
-                prevC = 0;
-            } else if (c == '\t') {
-                f(c, pos);
-                pos.x += atlasManager->getSpaceAdvance() * spaceSize * 4 * directionX;
-                prevC = c;
-            } else if (c == ' ') {
-                pos.x += atlasManager->getSpaceAdvance() * spaceSize * directionX;
-                f(c, pos);
-                prevC = c;
+        if (c == '\n') {
+            pos.y += lineStep;
+            pos.x = x;
+            prevIndex = 0;
+        } else if (c == '\t') {
+            f(c, pos, nullptr);
+            pos.x += tabStep;
+            prevIndex = tabIndex;
+        } else if (c == ' ') {
+            pos.x += spaceStep;
+            f(c, pos, nullptr);
+            prevIndex = spaceIndex;
+        } else {
+            // グリフを取得（遅延ロード、計測ならメトリクスのみ）
+            const LazyGlyphProps* props = LoadBitmaps ? manager.getOrLoadGlyph(c)
+                                                      : manager.getGlyphMetrics(c);
+            if (!props) continue;
+
+            if (useKerning && prevIndex > 0) {
+                pos.x += leftToRight ? manager.getKerningByIndex(prevIndex, props->glyphIndex)
+                                     : manager.getKerningByIndex(props->glyphIndex, prevIndex);
+            }
+            if (leftToRight) {
+                f(c, pos, props);
+                pos.x += props->advance * directionX + letterStep;
             } else {
-                // グリフを取得（遅延ロード）
-                const LazyGlyphProps* props = atlasManager->getOrLoadGlyph(c);
-                if (props) {
-                    if (prevC > 0) {
-                        if (settings.direction == OF_TTF_LEFT_TO_RIGHT) {
-                            pos.x += atlasManager->getKerning(prevC, c);
-                        } else {
-                            pos.x += atlasManager->getKerning(c, prevC);
-                        }
-                    }
-                    if (settings.direction == OF_TTF_LEFT_TO_RIGHT) {
-                        f(c, pos);
-                        pos.x += props->advance * directionX;
-                        pos.x += atlasManager->getSpaceAdvance() * (letterSpacing - 1.f) * directionX;
-                    } else {
-                        pos.x += props->advance * directionX;
-                        pos.x += atlasManager->getSpaceAdvance() * (letterSpacing - 1.f) * directionX;
-                        f(c, pos);
-                    }
-                    prevC = c;
-                }
+                pos.x += props->advance * directionX + letterStep;
+                f(c, pos, props);
             }
-        } catch (...) {
-            break;
+            prevIndex = props->glyphIndex;
         }
     }
 }
 
-void ofxTrueTypeFontLowRAM::drawCharInternal(uint32_t c, float x, float y, bool vFlipped) const {
-    if (!atlasManager) return;
+bool ofxTrueTypeFontLowRAM::makeGlyphQuad(const LazyGlyphProps& props, float x, float y, bool vFlipped,
+                                          GlyphQuad& quad) {
+    if (!props.hasBitmap) return false;  // バックグラウンドでラスタライズ中
+    if (props.atlasW == 0 || props.atlasH == 0) return false;  // アトラスに何も置いていない
+    if (!makeGlyphBounds(props, x, y, vFlipped, quad)) return false;
+
+    quad.u0 = props.t1;
+    quad.v0 = props.v1;
+    quad.u1 = props.t2;
+    quad.v1 = props.v2;
+    return true;
+}
 
-    const LazyGlyphProps* props = atlasManager->getOrLoadGlyph(c);
-    if (!props) return;
-    if (props->tW == 0 || props->tH == 0) return;  // スペースなど
+bool ofxTrueTypeFontLowRAM::makeGlyphBounds(const LazyGlyphProps& props, float x, float y, bool vFlipped,
+                                            GlyphQuad& quad) {
+    // メトリクスだけを使う（アトラス上の位置は読まない）
+    if (props.tW == 0 || props.tH == 0) return false;  // スペースなど
 
-    float xmin = props->xmin + x;
-    float ymin = props->ymin;
-    float xmax = props->xmax + x;
-    float ymax = props->ymax;
+    float ymin = props.ymin;
+    float ymax = props.ymax;
 
     if (!vFlipped) {
         ymin *= -1.0f;
         ymax *= -1.0f;
     }
-    ymin += y;
-    ymax += y;
 
-    // アトラスごとにメッシュを分ける
-    size_t atlasIdx = props->atlasIndex;
-    while (meshesPerAtlas.size() <= atlasIdx) {
-        meshesPerAtlas.push_back(ofMesh());
-        meshesPerAtlas.back().setMode(OF_PRIMITIVE_TRIANGLES);
+    quad.x0 = props.xmin + x;
+    quad.y0 = ymin + y;
+    quad.x1 = props.xmax + x;
+    quad.y1 = ymax + y;
+    return true;
+}
+
+void ofxTrueTypeFontLowRAM::drawCharInternal(const LazyGlyphProps& props, float x, float y, bool vFlipped,
+                                             vector<GlyphQuadBuffer>& buffers) {
+    GlyphQuad quad;
+    if (!makeGlyphQuad(props, x, y, vFlipped, quad)) return;
+
+    // アトラスごとにバッファを分ける
+    size_t atlasIdx = props.atlasIndex;
+    if (buffers.size() <= atlasIdx) {
+        buffers.resize(atlasIdx + 1);
     }
+    buffers[atlasIdx].addQuad(quad);
+}
+
+void ofxTrueTypeFontLowRAM::createStringMeshInternal(const string& s, float x, float y, bool vFlipped) const {
+    layoutStringQuads(*atlasManager, getLayoutSettings(), s, x, y, vFlipped, quadsPerAtlas);
+}
 
-    ofMesh& mesh = meshesPerAtlas[atlasIdx];
-    ofIndexType firstIndex = mesh.getVertices().size();
+void ofxTrueTypeFontLowRAM::layoutStringQuads(FontAtlasManager& manager, const LayoutSettings& layout, const string& s,
+                                              float x, float y, bool vFlipped, vector<GlyphQuadBuffer>& buffers) {
+    // 途中のグリフでアトラスが拡張されると、それより前のクアッドのテクスチャ座標が古くなる
+    // その場合はもう一度レイアウトする（2回目は全てロード済みなので配置は変わらない）
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint64_t generation = manager.getLayoutGeneration();
 
-    mesh.addVertex(glm::vec3(xmin, ymin, 0.f));
-    mesh.addVertex(glm::vec3(xmax, ymin, 0.f));
-    mesh.addVertex(glm::vec3(xmax, ymax, 0.f));
-    mesh.addVertex(glm::vec3(xmin, ymax, 0.f));
+        // バッファをクリア（確保済みの領域は残す）
+        for (auto& buffer : buffers) {
+            buffer.clear();
+        }
 
-    mesh.addTexCoord(glm::vec2(props->t1, props->v1));
-    mesh.addTexCoord(glm::vec2(props->t2, props->v1));
-    mesh.addTexCoord(glm::vec2(props->t2, props->v2));
-    mesh.addTexCoord(glm::vec2(props->t1, props->v2));
+        iterateString<true>(manager, layout, s, x, y, vFlipped, [&](uint32_t c, glm::vec2 pos, const LazyGlyphProps* props) {
+            if (props) {
+                drawCharInternal(*props, pos.x, pos.y, vFlipped, buffers);
+            }
+        });
 
-    mesh.addIndex(firstIndex);
-    mesh.addIndex(firstIndex + 1);
-    mesh.addIndex(firstIndex + 2);
-    mesh.addIndex(firstIndex + 2);
-    mesh.addIndex(firstIndex + 3);
-    mesh.addIndex(firstIndex);
+        if (generation == manager.getLayoutGeneration()) break;
+    }
 }
 
-void ofxTrueTypeFontLowRAM::createStringMeshInternal(const string& s, float x, float y, bool vFlipped) const {
-    // メッシュをクリア
-    for (auto& mesh : meshesPerAtlas) {
-        mesh.clear();
-    }
+void ofxTrueTypeFontLowRAM::drawQuadsInternal(FontAtlasManager& manager, const vector<GlyphQuadBuffer>& buffers) {
+    // このフレームで追加されたグリフをまとめて転送
+    manager.flushUploads();
 
-    iterateStringInternal(s, x, y, vFlipped, [this](uint32_t c, glm::vec2 pos) {
-        drawCharInternal(c, pos.x, pos.y, ofIsVFlipped());
-    });
+    ScopedTextBlend blend;
+
+    // 各アトラスのクアッドを描画
+    for (size_t i = 0; i < buffers.size(); i++) {
+        if (!buffers[i].empty()) {
+            manager.getTexture(i).bind();
+            buffers[i].draw();
+            manager.getTexture(i).unbind();
+        }
+    }
 }
 
 void ofxTrueTypeFontLowRAM::drawString(const string& s, float x, float y) const {
@@ -771,49 +2608,182 @@ void ofxTrueTypeFontLowRAM::drawString(const string& s, float x, float y) const
         return;
     }
 
+    if (activeBatch) {
+        // 開始時からの座標系の変化を頂点に反映する
+        glm::mat4 model = getCurrentModelMatrix();
+        if (model == batchModelMatrix) {
+            activeBatch->resetTransform();
+        } else {
+            activeBatch->setTransform(glm::inverse(batchModelMatrix) * model);
+        }
+        addToBatch(*activeBatch, s, x, y, ofGetStyle().color);
+        return;
+    }
+
     createStringMeshInternal(s, x, y, ofIsVFlipped());
+    drawQuadsInternal(*atlasManager, quadsPerAtlas);
+}
+
+void ofxTrueTypeFontLowRAM::addToBatch(TextBatch& batch, const string& s, float x, float y,
+                                       const ofFloatColor& color) const {
+    if (!bLoadedOk || !atlasManager) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "addToBatch(): Font not loaded";
+        return;
+    }
+
+    FontAtlasManager* manager = atlasManager.get();
+    bool vFlipped = ofIsVFlipped();
+    iterateStringInternal<true>(s, x, y, vFlipped, [&](uint32_t c, glm::vec2 pos, const LazyGlyphProps* props) {
+        GlyphQuad quad;
+        if (props && makeGlyphQuad(*props, pos.x, pos.y, vFlipped, quad)) {
+            batch.addQuad(manager, props->atlasIndex, quad, color);
+        }
+    });
+}
 
-    // ブレンド設定を保存
-    bool blendEnabled = glIsEnabled(GL_BLEND);
-    GLint blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha;
-    glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrcRGB);
-    glGetIntegerv(GL_BLEND_DST_RGB, &blendDstRGB);
-    glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendSrcAlpha);
-    glGetIntegerv(GL_BLEND_DST_ALPHA, &blendDstAlpha);
+void ofxTrueTypeFontLowRAM::addToInstances(GlyphInstanceBuilder& builder, const string& s, float x, float y,
+                                           const ofFloatColor& color) const {
+    if (!bLoadedOk || !atlasManager) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "addToInstances(): Font not loaded";
+        return;
+    }
+
+    FontAtlasManager* manager = atlasManager.get();
+    bool vFlipped = ofIsVFlipped();
+    iterateStringInternal<true>(s, x, y, vFlipped, [&](uint32_t c, glm::vec2 pos, const LazyGlyphProps* props) {
+        GlyphQuad quad;
+        if (!props || !makeGlyphQuad(*props, pos.x, pos.y, vFlipped, quad)) return;
+
+        GlyphInstance instance;
+        instance.x = quad.x0;
+        instance.y = quad.y0;
+        instance.atlasX = props->atlasX;
+        instance.atlasY = props->atlasY;
+        instance.width = quad.x1 - quad.x0;
+        instance.height = quad.y1 - quad.y0;
+        instance.atlasWidth = props->atlasW;
+        instance.atlasHeight = props->atlasH;
+        instance.color = color;
+        builder.addGlyph(manager, props->atlasIndex, instance);
+    });
+}
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+void ofxTrueTypeFontLowRAM::addToCommandBuffer(TextCommandBuffer& buffer, const string& s, float x, float y,
+                                               const ofFloatColor& color, bool vFlipped) const {
+    if (!bLoadedOk || !atlasManager) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "addToCommandBuffer(): Font not loaded";
+        return;
+    }
 
-    // 各アトラスのメッシュを描画
-    for (size_t i = 0; i < meshesPerAtlas.size(); i++) {
-        if (meshesPerAtlas[i].getNumVertices() > 0) {
-            atlasManager->getTexture(i).bind();
-            meshesPerAtlas[i].draw();
-            atlasManager->getTexture(i).unbind();
+    // 計測と同じくメトリクスだけでレイアウトする（テクスチャ座標はsubmit()で付ける）
+    FontAtlasManager* manager = atlasManager.get();
+    iterateStringInternal<false>(s, x, y, vFlipped, [&](uint32_t c, glm::vec2 pos, const LazyGlyphProps* props) {
+        GlyphQuad quad;
+        if (props && makeGlyphBounds(*props, pos.x, pos.y, vFlipped, quad)) {
+            buffer.addGlyph(manager, {c, quad.x0, quad.y0, quad.x1, quad.y1}, color);
         }
+    });
+}
+
+void ofxTrueTypeFontLowRAM::beginBatch() {
+    if (activeBatch) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "beginBatch(): already batching";
+        return;
+    }
+    static TextBatch sharedBatch;  // 配列はフレームをまたいで再利用する
+    sharedBatch.clear();
+    activeBatch = &sharedBatch;
+    batchModelMatrix = getCurrentModelMatrix();
+}
+
+void ofxTrueTypeFontLowRAM::endBatch() {
+    if (!activeBatch) {
+        ofLogWarning("ofxTrueTypeFontLowRAM") << "endBatch(): beginBatch() was not called";
+        return;
+    }
+    TextBatch* batch = activeBatch;
+    activeBatch = nullptr;
+
+    batch->draw();
+    batch->clear();
+}
+
+bool ofxTrueTypeFontLowRAM::isBatching() {
+    return activeBatch != nullptr;
+}
+
+ofxTrueTypeFontLowRAM::PreparedText ofxTrueTypeFontLowRAM::prepare(const string& s) const {
+    PreparedText prepared;
+    if (!bLoadedOk || !atlasManager) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "prepare(): Font not loaded";
+        return prepared;
+    }
+
+    prepared.manager = atlasManager;
+    prepared.layout = getLayoutSettings();
+    prepared.text = s;
+    for (auto c : ofUTF8Iterator(s)) {
+        prepared.codepoints.push_back(c);
+    }
+    sort(prepared.codepoints.begin(), prepared.codepoints.end());
+    prepared.codepoints.erase(unique(prepared.codepoints.begin(), prepared.codepoints.end()),
+                              prepared.codepoints.end());
+
+    prepared.vFlipped = ofIsVFlipped();
+    prepared.rebuild();
+    return prepared;
+}
+
+void ofxTrueTypeFontLowRAM::PreparedText::rebuild() const {
+    layoutStringQuads(*manager, layout, text, 0, 0, vFlipped, quadsPerAtlas);
+    generation = manager->getLayoutGeneration();
+    touchedFrame = ofGetFrameNum();  // レイアウト中に全てのグリフに印が付いている
+}
+
+size_t ofxTrueTypeFontLowRAM::PreparedText::getQuadCount() const {
+    size_t count = 0;
+    for (const auto& buffer : quadsPerAtlas) {
+        count += buffer.getQuadCount();
     }
+    return count;
+}
 
-    // ブレンド設定を復元
-    if (!blendEnabled) {
-        glDisable(GL_BLEND);
+void ofxTrueTypeFontLowRAM::PreparedText::draw(float x, float y) const {
+    if (!manager) return;
+
+    // フレームの境目でバックグラウンドのラスタライズ結果が配置される（配置されればレイアウトの世代が変わる）
+    uint64_t frame = ofGetFrameNum();
+    manager->setCurrentFrame(frame);
+
+    // 配置が変わっていたら作り直す
+    if (generation != manager->getLayoutGeneration() || vFlipped != ofIsVFlipped()) {
+        vFlipped = ofIsVFlipped();
+        rebuild();
+    } else if (manager->isEvictionEnabled() && touchedFrame != frame) {
+        // 描画し続けている間は追い出されないようにする（フレームごとに1回）
+        touchedFrame = frame;
+        manager->touchGlyphs(codepoints);
     }
-    glBlendFuncSeparate(blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha);
+
+    ofPushMatrix();
+    ofTranslate(x, y);
+    drawQuadsInternal(*manager, quadsPerAtlas);
+    ofPopMatrix();
 }
 
 float ofxTrueTypeFontLowRAM::stringWidth(const string& s) const {
     if (!bLoadedOk || !atlasManager) return 0;
 
     float w = 0;
-    iterateStringInternal(s, 0, 0, false, [&](uint32_t c, glm::vec2 pos) {
+    iterateStringInternal<false>(s, 0, 0, false, [&](uint32_t c, glm::vec2 pos, const LazyGlyphProps* props) {
         float cWidth = 0;
         if (settings.direction == OF_TTF_LEFT_TO_RIGHT) {
             if (c == '\t') {
                 cWidth = atlasManager->getSpaceAdvance() * spaceSize * 4;  // TAB_WIDTH = 4
+            } else if (props) {
+                cWidth = props->advance;
             } else {
-                const LazyGlyphProps* props = atlasManager->getOrLoadGlyph(c);
-                if (props) {
-                    cWidth = props->advance;
-                }
+                cWidth = atlasManager->getSpaceAdvance();
             }
         }
         w = max(w, abs(pos.x + cWidth));
@@ -835,9 +2805,12 @@ ofRectangle ofxTrueTypeFontLowRAM::getStringBoundingBox(const string& s, float x
     float maxY = y;
     float w = 0;
 
-    iterateStringInternal(s, x, y, vflip, [&](uint32_t c, glm::vec2 pos) {
-        const LazyGlyphProps* props = atlasManager->getOrLoadGlyph(c);
-        if (!props) return;
+    iterateStringInternal<false>(s, x, y, vflip, [&](uint32_t c, glm::vec2 pos, const LazyGlyphProps* props) {
+        if (!props) {
+            // スペース・タブ
+            props = atlasManager->getGlyphMetrics(c);
+            if (!props) return;
+        }
 
         float cWidth = 0;
         if (settings.direction == OF_TTF_LEFT_TO_RIGHT) {
@@ -874,8 +2847,8 @@ const ofMesh& ofxTrueTypeFontLowRAM::getStringMesh(const string& s, float x, flo
     // 複数アトラスの場合は getAllMeshes() などを別途実装すべき
     createStringMeshInternal(s, x, y, vFlipped);
 
-    if (!meshesPerAtlas.empty()) {
-        tempMesh = meshesPerAtlas[0];
+    if (!quadsPerAtlas.empty()) {
+        quadsPerAtlas[0].appendToMesh(tempMesh);
     }
 
     return tempMesh;
@@ -883,6 +2856,7 @@ const ofMesh& ofxTrueTypeFontLowRAM::getStringMesh(const string& s, float x, flo
 
 const ofTexture& ofxTrueTypeFontLowRAM::getFontTexture() const {
     if (atlasManager) {
+        atlasManager->flushUploads();
         return atlasManager->getTexture(0);
     }
     static ofTexture emptyTex;
@@ -895,6 +2869,7 @@ const vector<ofTexture>& ofxTrueTypeFontLowRAM::getAllTextures() const {
 
     // 注意: これは効率的ではない（コピーが発生）
     // 必要なら別の方法を検討
+    atlasManager->flushUploads();
     static vector<ofTexture> textures;
     textures.clear();
     for (size_t i = 0; i < atlasManager->getAtlasCount(); i++) {
@@ -915,16 +2890,71 @@ size_t ofxTrueTypeFontLowRAM::getTotalCacheMemoryUsage() {
     return SharedFontCache::getInstance().getTotalMemoryUsage();
 }
 
+size_t ofxTrueTypeFontLowRAM::getOpenFaceCount() {
+    return FontFacePool::getInstance().getFaceCount();
+}
+
+size_t ofxTrueTypeFontLowRAM::getMappedFontBytes() {
+    return FontFacePool::getInstance().getMappedBytes();
+}
+
+size_t ofxTrueTypeFontLowRAM::getResidentFontBytes() {
+    return FontFacePool::getInstance().getResidentBytes();
+}
+
+void ofxTrueTypeFontLowRAM::setTotalCacheMemoryBudget(size_t bytes) {
+    SharedFontCache::getInstance().setMemoryBudget(bytes);
+}
+
+void ofxTrueTypeFontLowRAM::setDefaultAtlasOptions(const FontAtlasOptions& options) {
+    SharedFontCache::getInstance().setDefaultOptions(options);
+}
+
 size_t ofxTrueTypeFontLowRAM::getLoadedGlyphCount() const {
     return atlasManager ? atlasManager->getLoadedGlyphCount() : 0;
 }
 
+size_t ofxTrueTypeFontLowRAM::preload(const std::u32string& characters) {
+    if (!atlasManager) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "preload(): Font not loaded";
+        return 0;
+    }
+    return atlasManager->preloadGlyphs(vector<uint32_t>(characters.begin(), characters.end()));
+}
+
+size_t ofxTrueTypeFontLowRAM::preload(const string& utf8) {
+    if (!atlasManager) {
+        ofLogError("ofxTrueTypeFontLowRAM") << "preload(): Font not loaded";
+        return 0;
+    }
+    vector<uint32_t> codepoints;
+    for (auto c : ofUTF8Iterator(utf8)) {
+        if (c != '\n' && c != '\t') codepoints.push_back(c);
+    }
+    return atlasManager->preloadGlyphs(codepoints);
+}
+
+size_t ofxTrueTypeFontLowRAM::getPendingGlyphCount() const {
+    return atlasManager ? atlasManager->getPendingGlyphCount() : 0;
+}
+
+float ofxTrueTypeFontLowRAM::getAtlasFillRatio() const {
+    return atlasManager ? atlasManager->getFillRatio() : 0.0f;
+}
+
+size_t ofxTrueTypeFontLowRAM::getMissingGlyphLookupCount() const {
+    return atlasManager ? atlasManager->getMissingLookupCount() : 0;
+}
+
 bool ofxTrueTypeFontLowRAM::isValidGlyph(uint32_t glyph) const {
     // 遅延ロードなので、基本的にはFreeTypeで描画可能なら有効
-    // ここでは常にtrueを返すか、実際にロードしてチェックするか選択
-    // パフォーマンスのため、ロード済みならチェック、そうでなければtrue
+    // パフォーマンスのため、ロード済みならtrue、存在しないと分かっていればfalse、
+    // まだ分からなければtrue
     if (atlasManager && atlasManager->hasGlyph(glyph)) {
         return true;
     }
+    if (atlasManager && atlasManager->isMissingGlyph(glyph)) {
+        return false;
+    }
     return true;  // 遅延ロードするので基本的にtrue
 }
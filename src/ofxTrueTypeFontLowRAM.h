@@ -2,12 +2,27 @@
 
 #include "ofTrueTypeFont.h"
 #include "ofFbo.h"
+#include "GlyphPacker.h"
+#include "GlyphTable.h"
+#include "GlyphQuadBuffer.h"
+#include "TextBatch.h"
+#include "TextCommandBuffer.h"
+#include "GlyphInstanceBuilder.h"
+#include "GlyphInstanceRenderer.h"
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
 using namespace std;
 
 // 前方宣言
 class FontAtlasManager;
+class MappedFile;
+class GlyphRasterizer;
+class SharedGlyphStore;
+struct RasterizedGlyph;
 
 // フォントキャッシュのキー（フォントパス + サイズ + アンチエイリアス）
 struct FontCacheKey {
@@ -32,77 +47,440 @@ struct FontCacheKeyHash {
     }
 };
 
+// アトラスの設定
+// SharedFontCacheのデフォルト設定として、新しく作られるアトラスに適用される
+struct FontAtlasOptions {
+    // カバレッジのみを1チャンネル（R8）で保持する
+    // 描画時にスウィズルで白＋アルファに展開するので見た目は同じで、メモリは半分になる
+    // GLESでは無視される（GRAY_ALPHAにフォールバック）
+    bool singleChannel = false;
+
+    // CPU側にアトラスのコピー（ofPixels）を保持する
+    // falseにするとグリフはテクスチャに直接部分転送され、CPU側のアトラス分のメモリが不要になる
+    // その代わりアトラス拡張時は常駐グリフを再ラスタライズして書き戻す
+    bool keepCpuPixels = true;
+
+    // アトラス内のグリフ配置方式
+    GlyphPackerType packer = GlyphPackerType::Skyline;
+
+    // メモリ予算（バイト、0なら無制限）
+    // アトラスを拡張・追加すると超える場合、しばらく使われていないグリフを追い出して領域を再利用する
+    size_t memoryBudget = 0;
+
+    // アトラス枚数の上限（0なら無制限）
+    size_t maxAtlasCount = 0;
+
+    // 追い出し対象になるまでの未使用フレーム数（1以上）
+    uint64_t evictAfterFrames = 300;
+
+    // フォントファイルを読み取り専用でmmapし、FT_New_Memory_Faceで開く
+    // ファイルのページはページキャッシュ・他プロセスと共有され、読んだテーブルの分だけが常駐する
+    // 同じファイルが既に開かれていれば、その開き方のまま共有される
+    bool memoryMapFont = false;
+
+    // フェイスを開くのを最初に使われるまで遅らせる
+    // load()ではパスの解決と存在確認だけを行い、フォントの解析は最初の描画・計測・メトリクス取得時に行う
+    // 起動時に多数のフォントを宣言するが、最初の画面ではその一部しか使わない場合に起動が速くなる
+    bool deferFaceLoad = false;
+
+    // グリフのラスタライズをバックグラウンドのワーカースレッドで行う
+    // 未ラスタライズのグリフはメトリクスだけで配置され（送り幅は正しいが描画されない）、
+    // 次のフレーム以降にラスタライズが終わったものからアトラスに配置される
+    bool asyncRasterization = false;
+
+    // ワーカースレッド数（0ならコア数-1、最低1）
+    size_t rasterizerThreads = 0;
+
+    // 1フレームにアトラスへ配置・転送するグリフ数の上限（0なら無制限）
+    size_t asyncGlyphsPerFrame = 64;
+
+    // アトラスのディスクキャッシュを置くディレクトリ（空なら使わない）
+    // setup時に同じフォントファイル（内容のハッシュ）・サイズ・AA・dpiのキャッシュがあれば読み込み、
+    // 前回ラスタライズしたグリフをそのまま使う。保存はsaveAtlasCache()で明示的に行う
+    of::filesystem::path atlasCacheDirectory;
+
+    // ラスタライズ済みグリフをプロセス間で共有するストアのディレクトリ（空なら使わない）
+    // 同じフォント・サイズ・AA・dpiを使う他のプロセスがラスタライズしたグリフはコピーして使う
+    // Linuxでは/dev/shm以下にすると共有メモリになる（Windowsでは未対応）
+    of::filesystem::path sharedGlyphStoreDirectory;
+
+    // 共有ストアのファイルサイズ（作成時のみ有効）
+    size_t sharedGlyphStoreSize = 64 * 1024 * 1024;
+
+    // グリフの使用状況（何フレームで使われたか、最初に使われた順）を記録するディレクトリ（空なら記録しない）
+    // 前回の記録があれば、load()時によく使われた順に先読みする（deferFaceLoadの場合はprewarmFromUsageProfile()で行う）
+    // 記録の保存はsaveUsageProfile()で明示的に行う
+    of::filesystem::path usageProfileDirectory;
+
+    // 記録から先読みするグリフ数の上限（0なら全部）
+    size_t usageProfilePrewarmLimit = 0;
+};
+
+// コピーできるatomic（読み書きはrelaxed）
+// 共有ロック中に複数のスレッドから書かれる値（最終使用フレームなど）に使う
+// グリフ表への追加やファイルへの保存でまとめてコピーされるので、コピーは値を写すだけにする
+template<typename T>
+class RelaxedAtomic {
+public:
+    RelaxedAtomic(T initial = T()) : value(initial) {}
+    RelaxedAtomic(const RelaxedAtomic& other) : value(other.load()) {}
+    RelaxedAtomic& operator=(const RelaxedAtomic& other) { store(other.load()); return *this; }
+    RelaxedAtomic& operator=(T newValue) { store(newValue); return *this; }
+    operator T() const { return load(); }
+
+    T load() const { return value.load(std::memory_order_relaxed); }
+    void store(T newValue) { value.store(newValue, std::memory_order_relaxed); }
+    T exchange(T newValue) { return value.exchange(newValue, std::memory_order_relaxed); }
+    T fetch_add(T delta) { return value.fetch_add(delta, std::memory_order_relaxed); }
+
+private:
+    std::atomic<T> value;
+};
+
+// グリフ情報はキャッシュファイルと共有メモリにそのまま書くので、中身は値と同じ並びでなければならない
+static_assert(sizeof(RelaxedAtomic<uint64_t>) == sizeof(uint64_t) && std::atomic<uint64_t>::is_always_lock_free,
+              "RelaxedAtomic must have the same layout as its value");
+
 // グリフ情報（テクスチャ座標など）
 struct LazyGlyphProps {
+    uint32_t glyphIndex;    // フォント内のグリフインデックス（カーニング用）
     size_t atlasIndex;      // どのアトラスに入っているか
     float t1, t2, v1, v2;   // テクスチャ座標
     float width, height;
     float bearingX, bearingY;
     float xmin, xmax, ymin, ymax;
     float advance;
-    float tW, tH;           // テクスチャ上のサイズ
+    float tW, tH;           // テクスチャ上のサイズ（メトリクスから求めた値）
+    int atlasX, atlasY;     // アトラス上のピクセル位置
+    int atlasW, atlasH;     // アトラスに配置したビットマップのサイズ（跡地の解放・書き戻しに使う）
+    RelaxedAtomic<uint64_t> lastUsedFrame;  // 最後に使われたフレーム（追い出し用、共有ロック中に書かれる）
+    bool hasBitmap;         // アトラスに配置済みか（falseならメトリクスのみ）
 };
 
 // フォントアトラス管理クラス
 // 同じフォント＋サイズで共有される
+//
+// スレッド:
+//   メトリクス・カーニング・グリフインデックスの取得（計測）はどのスレッドからでも呼べる
+//   グリフ表は読み取りを共有ロック、追加・配置を排他ロックで守り、FreeTypeの呼び出しはフェイスごとに直列化する
+//   配置済みのグリフを使った印（最終使用フレーム・使用状況）は共有ロックのままatomicに書く
+//   アトラスへの配置・追い出し・転送（getOrLoadGlyph・preloadGlyphs・flushUploadsなど）はGLスレッドで呼ぶ
+//   返されたグリフ情報のうちメトリクスは変わらないが、アトラス上の位置はGLスレッドでしか安定しない
 class FontAtlasManager {
 public:
     FontAtlasManager();
     ~FontAtlasManager();
 
     // 初期化
-    bool setup(const of::filesystem::path& fontPath, int fontSize, bool antialiased, int dpi = 0);
+    bool setup(const of::filesystem::path& fontPath, int fontSize, bool antialiased, int dpi = 0,
+               const FontAtlasOptions& options = FontAtlasOptions());
 
     // グリフを取得（なければ遅延ロード）
     const LazyGlyphProps* getOrLoadGlyph(uint32_t codepoint);
 
+    // メトリクスだけを取得（ラスタライズ・アトラス確保・GPU転送はしない）
+    // 返り値のatlasIndexやテクスチャ座標は、hasBitmapがtrueの時だけ有効
+    const LazyGlyphProps* getGlyphMetrics(uint32_t codepoint);
+
+    // 現在のフレーム番号を設定（グリフの最終使用フレームとして記録される）
+    // asyncRasterizationの場合、フレームが進んだ時にラスタライズ済みのグリフをアトラスに配置する
+    void setCurrentFrame(uint64_t frame);
+
+    // ラスタライズ済みのグリフを最大maxCount個アトラスに配置する（0なら全部、戻り値は配置した数）
+    // GLスレッドで呼ぶ。通常はsetCurrentFrameから呼ばれる
+    size_t integrateRasterizedGlyphs(size_t maxCount = 0);
+
+    // バックグラウンドでラスタライズ中のグリフ数
+    size_t getPendingGlyphCount() const;
+
+    // アトラス（ピクセル・グリフ表・配置状態）をatlasCacheDirectoryに保存する
+    // keepCpuPixels=falseの場合はテクスチャから読み戻すのでGLスレッドで呼ぶ（GLESでは不可）
+    bool saveAtlasCache();
+
+    // このアトラスのキャッシュファイルのパス（atlasCacheDirectoryが空なら空）
+    of::filesystem::path getAtlasCachePath() const;
+
+    // グリフの使用状況をusageProfileDirectoryに保存する（前回までの記録も半分の重みで引き継ぐ）
+    bool saveUsageProfile() const;
+
+    // 使用状況の記録から、よく使われた順に最大maxGlyphs個を先読みする（0なら全部、戻り値は配置した数）
+    size_t prewarmFromUsageProfile(size_t maxGlyphs = 0);
+
+    // このアトラスの使用状況ファイルのパス（usageProfileDirectoryが空なら空）
+    of::filesystem::path getUsageProfilePath() const;
+
+    // 共有ストアからコピーしたグリフ数（sharedGlyphStoreDirectory使用時）
+    size_t getSharedStoreHitCount() const { return sharedStoreHits; }
+
+    // 共有ストア（開いていなければnullptr）
+    const SharedGlyphStore* getSharedGlyphStore() const { return sharedStore.get(); }
+
+    // 複数のグリフをまとめてロードする（戻り値は新たにアトラスに配置した数）
+    // ラスタライズはワーカースレッドで並列に行い、高さ順に並べてから配置する
+    // GPUへの転送は次のflushUploadsでアトラスごとにまとめて行われる
+    size_t preloadGlyphs(const vector<uint32_t>& codepoints);
+
+    // 指定した文字を使用中として記録する（ロード済みのものだけ）
+    void touchGlyphs(const vector<uint32_t>& codepoints);
+
+    // グリフの配置（テクスチャ座標・アトラス番号）が変わるたびに増える
+    // レイアウト済みのメッシュはこれが変わったら作り直す必要がある
+    uint64_t getLayoutGeneration() const { return layoutGeneration; }
+
+    // アトラスが解放されてアトラス番号が詰められた回数
+    uint64_t getAtlasReleaseCount() const { return atlasReleaseCount; }
+
+    // 予算による追い出しが起こり得るか
+    bool isEvictionEnabled() const;
+
+    // メモリ予算を変更（0なら無制限）
+    void setBudget(size_t memoryBudgetBytes, size_t maxAtlasCount = 0);
+
+    uint64_t getCurrentFrame() const { return currentFrame; }
+
+    // 未使用フレーム数がevictAfterFrames以上のグリフを追い出す
+    // 戻り値は追い出したグリフ数
+    size_t evictStaleGlyphs();
+    size_t evictStaleGlyphs(uint64_t now);
+
+    // グリフのなくなったアトラスを解放する（戻り値は解放したバイト数）
+    size_t releaseEmptyAtlases();
+
+    // 古いグリフを追い出して空のアトラスを解放する（戻り値は解放したバイト数）
+    // SharedFontCacheが他のアトラスから回収する時に使う。他のスレッドが使用中なら何もしない
+    size_t tryReclaim(uint64_t now);
+
+    // アトラスを拡張・追加する前に呼ばれる判定（falseなら拡張しない）
+    // SharedFontCacheが全体の予算を守るために設定する。reclaimがfalseなら判定だけで、他からの回収はしない
+    void setGrowthGuard(function<bool(FontAtlasManager&, size_t, bool)> guard) { growthGuard = std::move(guard); }
+
+    // これまでに追い出したグリフ数
+    size_t getEvictedGlyphCount() const { return evictedGlyphCount; }
+
     // グリフが既にロード済みか
     bool hasGlyph(uint32_t codepoint) const;
 
+    // フォントに存在しない（またはロードに失敗した）と分かっている文字か
+    bool isMissingGlyph(uint32_t codepoint) const;
+
+    // 存在しない文字の数と、それらが参照された回数
+    size_t getMissingGlyphCount() const;
+    size_t getMissingLookupCount() const { return missingLookupCount; }
+
+    // 未転送の変更をGPUにアップロード（描画前に呼ぶ）
+    // 前回のフラッシュ以降に追加されたグリフは、アトラスごとに1回の部分転送にまとめられる
+    void flushUploads();
+
     // テクスチャを取得
     const ofTexture& getTexture(size_t atlasIndex = 0) const;
     size_t getAtlasCount() const { return atlases.size(); }
 
-    // フォントメトリクス
-    float getLineHeight() const { return lineHeight; }
-    float getAscenderHeight() const { return ascenderHeight; }
-    float getDescenderHeight() const { return descenderHeight; }
-    float getSpaceAdvance() const { return spaceAdvance; }
+    // アトラスのサイズ（ピクセル）
+    int getAtlasWidth(size_t atlasIndex) const { return atlasStates[atlasIndex].width; }
+    int getAtlasHeight(size_t atlasIndex) const { return atlasStates[atlasIndex].height; }
 
-    // メモリ使用量を取得（バイト単位）
-    size_t getMemoryUsage() const;
+    // フォントメトリクス（フェイスが開かれていなければ開く）
+    float getLineHeight() const { ensureFace(); return lineHeight; }
+    float getAscenderHeight() const { ensureFace(); return ascenderHeight; }
+    float getDescenderHeight() const { ensureFace(); return descenderHeight; }
+    float getSpaceAdvance() const { ensureFace(); return spaceAdvance; }
+
+    // フェイスを開いていなければ開く（deferFaceLoad用、失敗したらfalse）
+    bool ensureFace() const {
+        return faceOpened || (!faceOpenFailed && const_cast<FontAtlasManager*>(this)->openFace());
+    }
+    bool isFaceOpen() const { return faceOpened; }
+
+    // メモリ使用量を取得（バイト単位、最後に変更した時点の値なのでロックしない）
+    size_t getMemoryUsage() const { return memoryUsage; }
 
     // カーニング取得
     double getKerning(uint32_t leftC, uint32_t rightC) const;
 
+    // グリフインデックス同士のカーニング（結果はキャッシュされる）
+    float getKerningByIndex(uint32_t leftIndex, uint32_t rightIndex) const;
+
+    // 文字のグリフインデックス（ロード済みならFreeTypeを呼ばない）
+    uint32_t getGlyphIndex(uint32_t codepoint) const;
+
+    // カーニング情報を持つフォントか
+    bool hasKerning() const { ensureFace(); return kerningAvailable; }
+
     // グリフ数
-    size_t getLoadedGlyphCount() const { return glyphs.size(); }
+    size_t getLoadedGlyphCount() const;
+
+    // アトラスの充填率（全アトラスのグリフ面積 / アトラス面積）
+    float getFillRatio() const;
 
 private:
     // FreeTypeハンドル
+    // faceは同じフォントファイルの他のサイズと共有し、サイズはこのアトラス専用のFT_Sizeで持つ
     shared_ptr<struct FT_FaceRec_> face;
+    struct FT_SizeRec_* ftSize = nullptr;
+
+    // フォントファイル（解決済み）と、フェイスを開いたかどうか
+    of::filesystem::path fontFilePath;
+    std::atomic<bool> faceOpened{false};
+    std::atomic<bool> faceOpenFailed{false};
+
+    // フェイスを開いてサイズとメトリクスを設定する（複数のスレッドから呼ばれても1回だけ開く）
+    bool openFace();
+    std::mutex openMutex;
+
+    // フェイスを共有する全サイズで、FreeTypeの呼び出しを直列化する（FontFacePoolと共有）
+    shared_ptr<std::mutex> faceMutex;
+
+    // グリフ表・アトラス・キャッシュのロック（読み取りは共有、追加・配置は排他）
+    mutable std::shared_mutex glyphMutex;
+
+    // 排他ロック（メモリ使用量の変わる変更をしていれば、解放時にロックなしで読める値を更新する）
+    class WriteLock {
+    public:
+        explicit WriteLock(const FontAtlasManager& m) : manager(m), lock(m.glyphMutex) {}
+        ~WriteLock() { manager.refreshMemoryUsage(); }
+
+    private:
+        const FontAtlasManager& manager;
+        std::unique_lock<std::shared_mutex> lock;
+    };
+
+    // メモリ使用量（getMemoryUsageの値）と、その計算（ロックを持って呼ぶ）
+    // 計算は全アトラスと転送待ちを見るので、グリフ・アトラスを追加・追い出し・転送した時だけmemoryChangedを立てて行う
+    mutable std::atomic<size_t> memoryUsage{0};
+    mutable bool memoryChanged = false;
+    size_t computeMemoryUsage() const;
+    void refreshMemoryUsage() const;
+
+    // 以下のLocked版は排他ロックを持って呼ぶ
+    const LazyGlyphProps* getOrLoadGlyphLocked(uint32_t codepoint);
+    size_t integrateRasterizedGlyphsLocked(size_t maxCount);
+    size_t evictStaleGlyphsLocked(uint64_t now);
+    size_t releaseEmptyAtlasesLocked();
+
+    // 配置結果（アトラス上の位置と大きさ）だけを書き込む
+    // メトリクスは他のスレッドがロックなしで読んでいるので書き換えない
+    static void setPlacement(LazyGlyphProps& entry, const LazyGlyphProps& placed);
+
+    // フォントファイルの内容のハッシュ（ディスクキャッシュのキー）
+    uint64_t fontFileHash = 0;
+
+    // ディスクキャッシュからアトラスを復元する（なければ・合わなければfalse）
+    bool loadAtlasCache();
+
+    // キャッシュ・共有ストアのファイル名（フォント名・サイズ・AA・dpi・ハッシュ）
+    string getCacheFileName(const string& extension) const;
+
+    // グリフの使用状況（usageProfileDirectory使用時）
+    struct GlyphUsage {
+        RelaxedAtomic<uint32_t> frames = 0;  // 使われたフレーム数
+        uint32_t order = 0;                  // 最初に使われた順番
+        RelaxedAtomic<uint64_t> lastFrame = UINT64_MAX;
+    };
+    GlyphTable<GlyphUsage> usage;
+    uint32_t nextUsageOrder = 0;
+    bool recordingUsage = false;
+    void loadUsageProfile();
+
+    // 1フレームに1回だけ数える（共有ロックでよい）
+    void countUsage(GlyphUsage& entry) {
+        uint64_t frame = currentFrame;
+        if (entry.lastFrame != frame && entry.lastFrame.exchange(frame) != frame) {
+            entry.frames.fetch_add(1);
+        }
+    }
+
+    // 記録がなければ追加してから数える（排他ロックを持って呼ぶ）
+    void recordUsage(uint32_t codepoint) {
+        GlyphUsage* entry = usage.find(codepoint);
+        if (!entry) {
+            GlyphUsage first;
+            first.order = nextUsageOrder++;
+            entry = &usage.insert(codepoint, first);
+        }
+        countUsage(*entry);
+    }
+
+    // 配置済みのグリフを使った印を付ける（共有ロックでよい。記録を追加する必要があればfalse）
+    bool markUsed(uint32_t codepoint, LazyGlyphProps& props);
+
+    // プロセス間の共有ストア
+    unique_ptr<SharedGlyphStore> sharedStore;
+    std::atomic<size_t> sharedStoreHits{0};
+    void openSharedGlyphStore();
+
+    // このアトラスのサイズをfaceに設定する（FreeTypeでサイズに依存する処理の前に、faceMutexを持って呼ぶ）
+    void activateSize() const;
 
     // テクスチャアトラス（動的に増える可能性あり）
     vector<ofTexture> atlases;
-    vector<ofPixels> atlasPixels;  // CPU側のピクセルデータ（リサイズ用）
+    vector<ofPixels> atlasPixels;  // CPU側のピクセルデータ（リサイズ用、keepCpuPixels=falseなら空）
+
+    // CPU側コピーを持たない場合の転送待ちグリフ
+    struct PendingUpload {
+        size_t atlasIndex;
+        int x, y;
+        ofPixels pixels;
+    };
+    vector<PendingUpload> pendingUploads;
+
+    // 追い出したグリフの跡地（再利用される）
+    struct FreeRect {
+        int x, y, w, h;
+    };
 
-    // 各アトラスの現在の書き込み位置
+    // 各アトラスの状態
     struct AtlasState {
-        int currentX = 0;
-        int currentY = 0;
-        int currentRowHeight = 0;
+        unique_ptr<GlyphPacker> packer;  // グリフの配置
+        vector<FreeRect> freeRects;      // 追い出したグリフの領域
+        size_t glyphCount = 0;           // 配置されているグリフ数
         int width = 0;
         int height = 0;
+
+        // GPUに未転送の領域（dirtyX1 <= dirtyX0 なら変更なし）
+        int dirtyX0 = 0;
+        int dirtyY0 = 0;
+        int dirtyX1 = 0;
+        int dirtyY1 = 0;
+        // テクスチャの（再）確保が必要か（作成直後・拡張直後）
+        bool textureStale = true;
     };
     vector<AtlasState> atlasStates;
 
-    // ロード済みグリフ
-    unordered_map<uint32_t, LazyGlyphProps> glyphs;
+    // ロード済みグリフ（ASCII・BMPは配列で直接引く）
+    GlyphTable<LazyGlyphProps> glyphs;
+
+    // バックグラウンドのラスタライズ（asyncRasterizationで最初に必要になった時に起動）
+    unique_ptr<GlyphRasterizer> rasterizer;
+    unordered_set<uint32_t> pendingGlyphs;     // 依頼済みで未配置の文字
+    vector<RasterizedGlyph> rasterizedGlyphs;  // 受け取り用（使い回す）
+
+    // 存在しない・ロードできなかった文字（毎回FreeTypeに問い合わせないように記録）
+    unordered_set<uint32_t> missingGlyphs;
+    std::atomic<size_t> missingLookupCount{0};
+
+    // 追い出し（フレームと世代はロックなしで読まれる）
+    std::atomic<uint64_t> currentFrame{0};
+    std::atomic<uint64_t> layoutGeneration{0};
+    std::atomic<uint64_t> atlasReleaseCount{0};
+    std::atomic<size_t> evictedGlyphCount{0};
+    bool budgetWarningShown = false;
+    function<bool(FontAtlasManager&, size_t, bool)> growthGuard;
+
+    // 全体の予算で配置を断られた文字（どこかでメモリが解放されるまで、ラスタライズし直さない）
+    unordered_set<uint32_t> refusedGlyphs;
+    uint64_t refusedGeneration = 0;  // 記録した時のSharedFontCache::getFreedGeneration()
+    bool refusedWarningShown = false;
+    void refuseGlyph(uint32_t codepoint);
+    bool isRefused(uint32_t codepoint) const;
 
     // フォント設定
     int fontSize = 0;
     bool antialiased = true;
     int dpi = 96;
+    FontAtlasOptions options;
+
+    // アトラスのピクセルフォーマット（GRAY_ALPHA または GRAY）
+    ofPixelFormat atlasFormat = OF_PIXELS_GRAY_ALPHA;
 
     // フォントメトリクス
     float lineHeight = 0;
@@ -111,28 +489,127 @@ private:
     float spaceAdvance = 0;
     float fontUnitScale = 1.0f;
 
+    // カーニング
+    bool kerningAvailable = false;
+    uint32_t spaceGlyphIndex = 0;
+    uint32_t tabGlyphIndex = 0;
+    mutable unordered_map<uint64_t, float> kerningCache;  // (左 << 32 | 右) → カーニング
+
     // アトラスサイズ管理
     int minAtlasSize = 256;
     int maxAtlasSize = 4096;  // GL_MAX_TEXTURE_SIZEから取得
+    bool maxAtlasSizeQueried = false;
     int border = 1;           // グリフ間のボーダー
 
     // グリフをラスタライズしてアトラスに追加
     bool addGlyphToAtlas(uint32_t codepoint, LazyGlyphProps& outProps);
 
+    // ラスタライズ済みのピクセルをアトラスに配置（outPropsのメトリクスは設定済みであること）
+    bool placeGlyph(uint32_t codepoint, ofPixels& glyphPixels, LazyGlyphProps& outProps);
+
+    // メトリクスだけ読み、ラスタライズをワーカーに依頼する（asyncRasterization用）
+    const LazyGlyphProps* requestGlyphAsync(uint32_t codepoint, LazyGlyphProps* found);
+
+    // グリフの配置場所を確保（跡地の再利用 → 既存アトラス → 拡張・追加）
+    bool allocateRegion(int w, int h, size_t& outAtlasIndex, int& outX, int& outY);
+
+    // 跡地か既存アトラスの空きから確保（拡張はしない）
+    bool findFreeSpace(int w, int h, size_t& outAtlasIndex, int& outX, int& outY);
+
+    // 拡張・追加の許可を得る（reclaimなら足りない分を他のアトラスから回収する）
+    bool reserveGrowth(size_t additionalBytes, bool reclaim);
+
+    // 追い出したグリフの跡地から確保
+    bool takeFreeRect(int w, int h, size_t& outAtlasIndex, int& outX, int& outY);
+
+    // 予算内に収まるか
+    bool isWithinBudget(size_t additionalBytes, bool addsAtlas) const;
+
+    // アトラス1枚分のバイト数
+    size_t getAtlasBytes(int size) const;
+
+    // アトラスの一部を透明に戻す
+    void clearRegion(size_t atlasIndex, int x, int y, int w, int h);
+
+    // グリフがなくなったアトラスを空の状態に戻す
+    void resetAtlas(size_t atlasIndex);
+
     // 現在のアトラスを2倍に拡張
     bool expandAtlas(size_t atlasIndex);
 
     // 新しいアトラスを作成
     size_t createNewAtlas();
 
+    // 変更領域を記録（実際の転送はflushUploadsで行う）
+    void markDirty(size_t atlasIndex, int x, int y, int w, int h);
+
+    // テクスチャを確保して全体を転送（CPU側コピーがなければ透明で初期化）
+    void allocateTexture(size_t atlasIndex);
+
+    // CPU側ピクセルの一部だけをテクスチャに転送
+    void uploadRegion(size_t atlasIndex, int x, int y, int w, int h);
+
+    // 任意のピクセルデータをテクスチャの指定位置に転送
+    void uploadPixels(size_t atlasIndex, int x, int y, int w, int h,
+                      const unsigned char* data, int rowLength);
+
+    // CPU側コピーなしでアトラスを拡張した時、常駐グリフを再ラスタライズして転送待ちに積む
+    void rerasterizeAtlas(size_t atlasIndex);
+
+    // グリフをFreeTypeのスロットに読み込む（存在しなければ記録してfalse）
+    // フェイスを開いてから、faceMutexを持って呼ぶ（スロットを読み終わるまで離さない）
+    bool loadGlyphSlot(uint32_t codepoint, LazyGlyphProps& outProps);
+
+    // グリフのメトリクスだけを取得
+    bool loadGlyphMetrics(uint32_t codepoint, LazyGlyphProps& outProps);
+
     // グリフのピクセルデータを取得
     bool rasterizeGlyph(uint32_t codepoint, ofPixels& outPixels, LazyGlyphProps& outProps);
 
+    // 空のアトラス（透明）で塗りつぶす
+    void clearAtlasPixels(ofPixels& pixels) const;
+
+    // 1ピクセルあたりのバイト数
+    size_t getBytesPerPixel() const { return atlasFormat == OF_PIXELS_GRAY ? 1 : 2; }
+
     // GL最大テクスチャサイズを取得
     static int getMaxTextureSize();
 };
 
+// FT_Faceの共有プール（シングルトン）
+// 同じフォントファイルはサイズが違っても1回だけ開いて解析し、サイズごとの違いはFT_Sizeで持つ
+// フェイスは使っているアトラスがなくなった時点で閉じる
+class FontFacePool {
+public:
+    static FontFacePool& getInstance();
+
+    // 解決済みのパスのフェイスを取得（なければ開く。memoryMapならmmapして開く）
+    shared_ptr<struct FT_FaceRec_> acquire(const of::filesystem::path& resolvedPath, bool memoryMap = false);
+
+    // フェイスを使うFreeTypeの呼び出しを直列化するロック（同じパスのサイズ違いで共有）
+    shared_ptr<std::mutex> getFaceMutex(const of::filesystem::path& resolvedPath);
+
+    // 開いているフェイス数
+    size_t getFaceCount() const;
+
+    // mmapしたフォントファイルの合計サイズと、そのうち物理メモリに常駐している分
+    size_t getMappedBytes() const;
+    size_t getResidentBytes() const;
+
+private:
+    FontFacePool() = default;
+
+    struct Entry {
+        weak_ptr<struct FT_FaceRec_> face;
+        weak_ptr<MappedFile> file;  // mmapで開いた場合のみ
+        shared_ptr<std::mutex> faceMutex;
+    };
+    unordered_map<string, Entry> faces;
+    mutable std::mutex poolMutex;
+};
+
 // 共有フォントキャッシュ（シングルトン）
+// どのスレッドからでもロード（getOrCreate）できる。ただし使用状況からの先読みはメインスレッドでだけ行う
 class SharedFontCache {
 public:
     static SharedFontCache& getInstance();
@@ -149,8 +626,47 @@ public:
     // 総メモリ使用量
     size_t getTotalMemoryUsage() const;
 
+    // 全体のメモリ予算（バイト、0なら無制限）
+    // 超えそうになると、参照されていないアトラスの解放 → 古いグリフの追い出しの順に回収し、
+    // それでも足りなければアトラスを拡張しない（そのグリフは描画されない）
+    void setMemoryBudget(size_t bytes) { memoryBudget = bytes; notifyMemoryFreed(); }
+    size_t getMemoryBudget() const { return memoryBudget; }
+
+    // メモリが解放される（予算が変わる）たびに増える番号
+    // 予算で配置を断られたグリフは、この番号が変わるまで試し直さない
+    uint64_t getFreedGeneration() const { return freedGeneration; }
+    void notifyMemoryFreed() { freedGeneration++; }
+
+    // deferFaceLoadでまだ開かれていないフェイスを最大maxCount個開く（戻り値は開いた数）
+    // update()などで毎フレーム少しずつ呼ぶと、最初のフレームを遅らせずに後から準備できる
+    size_t openDeferredFaces(size_t maxCount = 1);
+
+    // usageProfileDirectoryが設定されたアトラスの使用状況をすべて保存する（戻り値は保存した数）
+    size_t saveUsageProfiles();
+
+    // atlasCacheDirectoryが設定されたアトラスをすべてディスクに保存する（戻り値は保存した数）
+    // 終了時（ofApp::exit()など）に呼ぶ
+    size_t saveAtlasCaches();
+
+    // 新しく作るアトラスのデフォルト設定（作成済みのアトラスには影響しない）
+    void setDefaultOptions(const FontAtlasOptions& options);
+    FontAtlasOptions getDefaultOptions() const;
+
 private:
     SharedFontCache() = default;
+    FontAtlasOptions defaultOptions;
+    std::atomic<size_t> memoryBudget{0};
+    std::atomic<uint64_t> freedGeneration{0};
+
+    // requesterのアトラスをadditionalBytes増やせるか判定し、reclaimなら足りない分を他から回収する
+    // requesterの排他ロックを持ったまま呼ばれるので、他のアトラスはロックできた時だけ回収する
+    bool reserve(FontAtlasManager& requester, size_t additionalBytes, bool reclaim);
+
+    // 登録されているアトラスの一覧（ロックを離してから各アトラスを操作するため）
+    vector<shared_ptr<FontAtlasManager>> getManagers() const;
+
+    // cacheとdefaultOptionsのロック（持ったまま各アトラスのロックを待たない）
+    mutable std::mutex cacheMutex;
     unordered_map<FontCacheKey, shared_ptr<FontAtlasManager>, FontCacheKeyHash> cache;
 };
 
@@ -177,9 +693,82 @@ public:
 
     bool load(const ofTrueTypeFontSettings& settings);
 
+private:
+    // 文字の並べ方に使うフォントの値（PreparedTextがフォント本体なしでレイアウトし直せるようにまとめる）
+    struct LayoutSettings {
+        float lineHeight = 0;
+        float letterSpacing = 1;
+        float spaceSize = 1;
+        bool leftToRight = true;
+    };
+
+public:
+    // レイアウト済みの文字列
+    // prepare()で作成し、毎フレームdraw()する。描画時にUTF-8の解析やクアッドの再計算をしない
+    // アトラスの拡張や追い出しでグリフの配置が変わった時は、次のdraw()で自動的に作り直す
+    // アトラスとレイアウトの値を自分で持つので、作成元のフォントの移動・再ロード・破棄の後も作成時の内容で描画できる
+    class PreparedText {
+    public:
+        void draw(float x, float y) const;
+
+        const string& getText() const { return text; }
+        bool isPrepared() const { return manager != nullptr; }
+
+        // 描画するクアッド数（バックグラウンドでラスタライズ中のグリフは含まない）
+        size_t getQuadCount() const;
+
+    private:
+        friend class ofxTrueTypeFontLowRAM;
+
+        shared_ptr<FontAtlasManager> manager;
+        LayoutSettings layout;
+        string text;
+        vector<uint32_t> codepoints;  // 使用中として記録するための文字
+        mutable bool vFlipped = true;
+        mutable uint64_t generation = 0;
+        mutable uint64_t touchedFrame = UINT64_MAX;  // 使用中の印を付けたフレーム（同じフレームで何度描いても1回だけ）
+        mutable vector<GlyphQuadBuffer> quadsPerAtlas;  // GPUバッファは作り直すまで再利用
+
+        void rebuild() const;
+    };
+
+    // 文字列をレイアウトしておく（原点基準、描画位置はdraw()で指定）
+    PreparedText prepare(const string& s) const;
+
+    // メトリクス（隠蔽、deferFaceLoadの場合はここでフェイスが開かれる）
+    float getLineHeight() const;
+    void setLineHeight(float height);
+    float getAscenderHeight() const;
+    float getDescenderHeight() const;
+
+    // deferFaceLoadで開かれていないフェイスを最大maxCount個開く
+    static size_t openDeferredFaces(size_t maxCount = 1);
+
     // 描画（オーバーライドではなく隠蔽）
+    // beginBatch()〜endBatch()の間ではその場で描画せず、バッチに追加される
     void drawString(const string& s, float x, float y) const;
 
+    // バッチ描画
+    // 間に呼ばれたdrawStringを（全フォント分）まとめ、endBatch()でアトラスごとに1回だけ描画する
+    // 文字色は各drawString時点のofSetColorの色。begin/endは同じ座標系で呼ぶこと
+    static void beginBatch();
+    static void endBatch();
+    static bool isBatching();
+
+    // 文字列を指定したバッチに追加（描画はbatch.draw()で行う）
+    void addToBatch(TextBatch& batch, const string& s, float x, float y, const ofFloatColor& color) const;
+
+    // 文字列をインスタンス描画用に追加（1文字あたり頂点4つの代わりにGlyphInstance1つ）
+    // 描画はGlyphInstanceRenderer::draw()で行う
+    void addToInstances(GlyphInstanceBuilder& builder, const string& s, float x, float y,
+                        const ofFloatColor& color) const;
+
+    // 文字列をレイアウトしてコマンドバッファに追加（どのスレッドからでも呼べる）
+    // メトリクスだけを使うのでアトラスもGLも使わない。描画はGLスレッドでbuffer.submit(batch)してbatch.draw()
+    // ワーカースレッドではofIsVFlipped()を使えないので、上下の向きは引数で指定する
+    void addToCommandBuffer(TextCommandBuffer& buffer, const string& s, float x, float y,
+                            const ofFloatColor& color, bool vFlipped = true) const;
+
     // 文字列サイズ計算（隠蔽）
     float stringWidth(const string& s) const;
     float stringHeight(const string& s) const;
@@ -201,9 +790,46 @@ public:
     // 共有キャッシュ全体のメモリ使用量
     static size_t getTotalCacheMemoryUsage();
 
+    // 共有キャッシュ全体のメモリ予算（0なら無制限）
+    static void setTotalCacheMemoryBudget(size_t bytes);
+
+    // 開いているフォントファイル（FT_Face）の数（サイズ違いは共有される）
+    static size_t getOpenFaceCount();
+
+    // mmapしたフォントファイルの合計サイズと、そのうち常駐している分（memoryMapFont使用時）
+    static size_t getMappedFontBytes();
+    static size_t getResidentFontBytes();
+
+    // アトラスのディスクキャッシュを保存する（atlasCacheDirectoryを設定したもの、終了時に呼ぶ）
+    static size_t saveAtlasCaches();
+
+    // グリフの使用状況を保存する（usageProfileDirectoryを設定したもの、終了時に呼ぶ）
+    static size_t saveUsageProfiles();
+
+    // 以降にロードされるフォントのアトラス設定（load()より前に呼ぶ）
+    static void setDefaultAtlasOptions(const FontAtlasOptions& options);
+
+    // 文字セットをまとめてロードしておく（常用漢字表やローカライズ文字列など）
+    // 複数コアで並列にラスタライズし、高さ順に詰めて、アトラスごとに1回だけ転送する
+    // 戻り値は新たにロードしたグリフ数。GLスレッドで呼ぶ
+    size_t preload(const std::u32string& characters);
+    size_t preload(const string& utf8);
+
     // ロード済みグリフ数
     size_t getLoadedGlyphCount() const;
 
+    // バックグラウンドでラスタライズ中のグリフ数（asyncRasterization使用時）
+    size_t getPendingGlyphCount() const;
+
+    // フォントに存在しない文字が参照された回数
+    size_t getMissingGlyphLookupCount() const;
+
+    // アトラスの充填率（0〜1）
+    float getAtlasFillRatio() const;
+
+    // 共有しているアトラス（予算の変更などに使う）
+    shared_ptr<FontAtlasManager> getAtlasManager() const { return atlasManager; }
+
     // 有効なグリフかチェック（遅延ロードなので常にtrueを返す傾向）
     bool isValidGlyph(uint32_t glyph) const;
 
@@ -211,17 +837,40 @@ private:
     shared_ptr<FontAtlasManager> atlasManager;
     FontCacheKey cacheKey;
 
+    // 親クラスのメトリクスをアトラスから設定済みか（deferFaceLoadでは最初に使う時に設定する）
+    mutable std::atomic<bool> metricsSynced{false};
+    void syncMetrics() const;
+
     // 描画用の一時メッシュ
     mutable ofMesh tempMesh;
 
-    // 複数アトラス対応の描画用メッシュ
-    mutable vector<ofMesh> meshesPerAtlas;
+    // 複数アトラス対応の描画用バッファ（フレームをまたいで再利用）
+    mutable vector<GlyphQuadBuffer> quadsPerAtlas;
+
+    // beginBatch()中のバッチと、開始時のモデル行列
+    static TextBatch* activeBatch;
+    static glm::mat4 batchModelMatrix;
+
+    // 現在のレイアウトの値（deferFaceLoadの場合はここでフェイスのメトリクスを反映する）
+    LayoutSettings getLayoutSettings() const;
 
     // 内部描画ヘルパー
+    // アトラスとレイアウトの値を引数で受け取るものは、PreparedTextからも使う
     void createStringMeshInternal(const string& s, float x, float y, bool vFlipped) const;
-    void drawCharInternal(uint32_t c, float x, float y, bool vFlipped) const;
+    static void layoutStringQuads(FontAtlasManager& manager, const LayoutSettings& layout, const string& s,
+                                  float x, float y, bool vFlipped, vector<GlyphQuadBuffer>& buffers);
+    static void drawCharInternal(const LazyGlyphProps& props, float x, float y, bool vFlipped, vector<GlyphQuadBuffer>& buffers);
+    static bool makeGlyphQuad(const LazyGlyphProps& props, float x, float y, bool vFlipped, GlyphQuad& quad);
+    static bool makeGlyphBounds(const LazyGlyphProps& props, float x, float y, bool vFlipped, GlyphQuad& quad);
+    static void drawQuadsInternal(FontAtlasManager& manager, const vector<GlyphQuadBuffer>& buffers);
 
     // 文字列を反復処理
-    void iterateStringInternal(const string& str, float x, float y, bool vFlipped,
-                               function<void(uint32_t, glm::vec2)> f) const;
+    // f(uint32_t c, glm::vec2 pos, const LazyGlyphProps* props) が文字ごとに呼ばれる
+    // （スペース・タブではpropsはnullptr）
+    // LoadBitmapsがfalseならメトリクスだけを使う（計測用、ラスタライズしない）
+    template<bool LoadBitmaps, typename Callback>
+    void iterateStringInternal(const string& str, float x, float y, bool vFlipped, Callback&& f) const;
+    template<bool LoadBitmaps, typename Callback>
+    static void iterateString(FontAtlasManager& manager, const LayoutSettings& layout, const string& str,
+                              float x, float y, bool vFlipped, Callback&& f);
 };
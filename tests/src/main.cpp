@@ -0,0 +1,282 @@
+#include "ofMain.h"
+#include "ofxTrueTypeFontLowRAM.h"
+
+// GlyphInstanceBuilder・TextBatch・PreparedTextのテスト
+// アトラスの作成にGLが必要なのでウィンドウを開き、setup()で確認できるものを確認する
+// フレームをまたぐもの（非同期ラスタライズ）はdraw()で確認し、全て終わったら終了する（失敗があれば終了コード1）
+
+class ofApp : public ofBaseApp {
+public:
+    void setup() {
+        // システムフォントの解決はmacOSでしか行わないので、どの環境でも読めるようにbin/dataに同梱したものを使う
+        fontPath = "Lato-Regular.ttf";
+
+        testGroupsByAtlas();
+        testReleaseCountSplit();
+        testClearKeepsCapacity();
+        testInstanceContents();
+        testTextBatch();
+        startAsyncPreparedText();
+    }
+
+    void draw() {
+        if (asyncFrames >= 0) {
+            stepAsyncPreparedText();
+            return;
+        }
+        ofLogNotice("tests") << (checks - failures) << "/" << checks << " checks passed";
+        ofExit(failures > 0 ? 1 : 0);
+    }
+
+private:
+    string fontPath;
+    int checks = 0;
+    int failures = 0;
+
+    // 非同期ラスタライズ + PreparedText（asyncFramesが負なら終了済み）
+    ofxTrueTypeFontLowRAM asyncFont;
+    ofxTrueTypeFontLowRAM::PreparedText asyncText;
+    int asyncFrames = -1;
+
+    void check(bool condition, const string& what) {
+        checks++;
+        if (!condition) {
+            failures++;
+            ofLogError("tests") << "FAILED: " << what;
+        }
+    }
+
+    static GlyphInstance makeInstance(float x) {
+        GlyphInstance instance;
+        instance.x = x;
+        instance.y = 0;
+        instance.atlasX = instance.atlasY = 0;
+        instance.width = instance.height = 1;
+        instance.atlasWidth = instance.atlasHeight = 1;
+        instance.color = ofFloatColor::white;
+        return instance;
+    }
+
+    // (アトラス管理, アトラス番号)ごとにまとまり、追加順が保たれる
+    void testGroupsByAtlas() {
+        FontAtlasManager managerA;
+        FontAtlasManager managerB;
+        GlyphInstanceBuilder builder;
+        builder.addGlyph(&managerA, 0, makeInstance(0));
+        builder.addGlyph(&managerB, 0, makeInstance(1));
+        builder.addGlyph(&managerA, 1, makeInstance(2));
+        builder.addGlyph(&managerA, 0, makeInstance(3));
+        builder.addGlyph(&managerB, 0, makeInstance(4));
+
+        check(builder.getInstanceCount() == 5, "groups: instance count");
+        const auto& groups = builder.getGroups();
+        check(groups.size() == 3, "groups: one group per (manager, atlas)");
+        if (groups.size() != 3) return;
+
+        check(groups[0].manager == &managerA && groups[0].atlasIndex == 0, "groups: first group is (A, 0)");
+        check(groups[1].manager == &managerB && groups[1].atlasIndex == 0, "groups: second group is (B, 0)");
+        check(groups[2].manager == &managerA && groups[2].atlasIndex == 1, "groups: third group is (A, 1)");
+        check(groups[0].instances.size() == 2 && groups[0].instances[0].x == 0 && groups[0].instances[1].x == 3,
+              "groups: (A, 0) keeps insertion order");
+        check(groups[1].instances.size() == 2 && groups[1].instances[1].x == 4, "groups: (B, 0) instances");
+        check(groups[2].instances.size() == 1 && groups[2].instances[0].x == 2, "groups: (A, 1) instances");
+    }
+
+    // アトラス番号が詰められた後は、同じ番号でも別のグループになる
+    void testReleaseCountSplit() {
+        FontAtlasManager manager;
+        if (!manager.setup(fontPath, 24, true)) {
+            check(false, "release count: font setup");
+            return;
+        }
+        manager.setCurrentFrame(1);
+        const LazyGlyphProps* props = manager.getOrLoadGlyph('A');
+        check(props && props->hasBitmap && props->atlasIndex == 0, "release count: glyph placed in atlas 0");
+
+        GlyphInstanceBuilder builder;
+        builder.addGlyph(&manager, 0, makeInstance(0));
+
+        uint64_t releaseCount = manager.getAtlasReleaseCount();
+        manager.evictStaleGlyphs(1000000);
+        manager.releaseEmptyAtlases();
+        check(manager.getAtlasReleaseCount() != releaseCount, "release count: empty atlas released");
+
+        builder.addGlyph(&manager, 0, makeInstance(1));
+        const auto& groups = builder.getGroups();
+        check(groups.size() == 2, "release count: split into two groups");
+        if (groups.size() != 2) return;
+        check(groups[0].atlasReleaseCount == releaseCount, "release count: first group keeps the old count");
+        check(groups[1].atlasReleaseCount == manager.getAtlasReleaseCount(), "release count: second group has the new count");
+        check(groups[0].instances.size() == 1 && groups[1].instances.size() == 1, "release count: one instance each");
+    }
+
+    // clear()はグループを空きとして残し、配列の容量を再利用する
+    void testClearKeepsCapacity() {
+        FontAtlasManager manager;
+        GlyphInstanceBuilder builder;
+        for (int i = 0; i < 100; i++) {
+            builder.addGlyph(&manager, 0, makeInstance(i));
+        }
+        size_t capacity = builder.getGroups()[0].instances.capacity();
+
+        builder.clear();
+        check(builder.empty() && builder.getInstanceCount() == 0, "clear: no instances");
+        check(builder.getGroups().size() == 1, "clear: group kept");
+        check(builder.getGroups()[0].manager == nullptr, "clear: group marked free");
+        check(builder.getGroups()[0].instances.empty(), "clear: group emptied");
+        check(builder.getGroups()[0].instances.capacity() == capacity, "clear: capacity kept");
+
+        // 空いたグループが再利用される
+        FontAtlasManager other;
+        builder.addGlyph(&other, 2, makeInstance(0));
+        check(builder.getGroups().size() == 1, "clear: free group reused");
+        check(builder.getGroups()[0].manager == &other && builder.getGroups()[0].atlasIndex == 2,
+              "clear: reused group has the new key");
+        check(builder.getGroups()[0].instances.capacity() == capacity, "clear: reused group keeps capacity");
+    }
+
+    // addToInstancesの内容がグリフ情報と一致する
+    void testInstanceContents() {
+        ofxTrueTypeFontLowRAM font;
+        if (!font.load(fontPath, 24, true)) {
+            check(false, "contents: font load");
+            return;
+        }
+        auto manager = font.getAtlasManager();
+        manager->setCurrentFrame(1);
+        const LazyGlyphProps* props = manager->getOrLoadGlyph('W');
+        check(props && props->hasBitmap && props->atlasW > 0, "contents: glyph placed");
+        if (!props) return;
+
+        GlyphInstanceBuilder builder;
+        ofFloatColor color(0.25f, 0.5f, 0.75f, 1.0f);
+        font.addToInstances(builder, "W", 10, 20, color);
+        check(builder.getInstanceCount() == 1, "contents: one instance");
+        if (builder.getInstanceCount() != 1) return;
+
+        const GlyphInstanceBuilder::Group& group = builder.getGroups()[0];
+        const GlyphInstance& instance = group.instances[0];
+        check(group.manager == manager.get() && group.atlasIndex == props->atlasIndex, "contents: group key");
+        check(instance.atlasX == props->atlasX && instance.atlasY == props->atlasY, "contents: atlas position");
+        check(instance.atlasWidth == props->atlasW && instance.atlasHeight == props->atlasH, "contents: atlas size");
+        check(ofIsFloatEqual(instance.x, 10 + props->xmin), "contents: x");
+        check(ofIsFloatEqual(instance.width, props->xmax - props->xmin), "contents: width");
+        check(ofIsFloatEqual(std::abs(instance.height), props->ymax - props->ymin), "contents: height");
+        check(instance.color == color, "contents: color");
+    }
+
+    static GlyphQuad makeQuad(float x) {
+        GlyphQuad quad;
+        quad.x0 = x;
+        quad.y0 = 0;
+        quad.x1 = x + 10;
+        quad.y1 = 20;
+        quad.u0 = quad.v0 = 0;
+        quad.u1 = quad.v1 = 0.5f;
+        return quad;
+    }
+
+    // TextBatchの組み立て（GLは使わない）
+    // グループはアトラスの大きさを読むので、アトラスを持つ（グリフを1つ配置した）アトラス管理を使う
+    void testTextBatch() {
+        FontAtlasManager managerA;
+        FontAtlasManager managerB;
+        if (!managerA.setup(fontPath, 24, true) || !managerB.setup(fontPath, 30, true)) {
+            check(false, "batch: font setup");
+            return;
+        }
+        managerA.getOrLoadGlyph('A');
+        managerB.getOrLoadGlyph('B');
+
+        ofFloatColor red(1, 0, 0, 1);
+        ofFloatColor blue(0, 0, 1, 0.5f);
+        TextBatch batch;
+        batch.addQuad(&managerA, 0, makeQuad(0), red);
+        batch.addQuad(&managerB, 0, makeQuad(100), red);
+        batch.addQuad(&managerA, 0, makeQuad(200), blue);
+
+        // (アトラス管理, アトラス番号)ごとのグループ分け
+        check(batch.getQuadCount() == 3, "batch: quad count");
+        const auto& groups = batch.getGroups();
+        check(groups.size() == 2, "batch: one group per (manager, atlas)");
+        if (groups.size() != 2) return;
+        check(groups[0].manager == &managerA && groups[0].atlasIndex == 0, "batch: first group is (A, 0)");
+        check(groups[1].manager == &managerB && groups[1].atlasIndex == 0, "batch: second group is (B, 0)");
+        check(groups[0].quads.getQuadCount() == 2 && groups[1].quads.getQuadCount() == 1, "batch: quads per group");
+        check(groups[0].atlasWidth == managerA.getAtlasWidth(0), "batch: group keeps the atlas size");
+
+        // 頂点ごとの色（クアッドごとに4頂点）
+        const auto& vertices = groups[0].quads.getVertices();
+        const auto& colors = groups[0].quads.getColors();
+        check(vertices.size() == 8 && colors.size() == 8, "batch: four vertices and colors per quad");
+        if (vertices.size() == 8 && colors.size() == 8) {
+            bool colorsMatch = true;
+            for (int i = 0; i < 4; i++) {
+                colorsMatch = colorsMatch && colors[i] == red && colors[4 + i] == blue;
+            }
+            check(colorsMatch, "batch: per-vertex color");
+            check(vertices[4].x == 200 && vertices[6].x == 210 && vertices[6].y == 20, "batch: vertex positions");
+        }
+        check(groups[1].quads.getColors().size() == 4 && groups[1].quads.getColors()[0] == red, "batch: color in other group");
+
+        // clear()はグループと配列の容量を残す
+        for (int i = 0; i < 100; i++) {
+            batch.addQuad(&managerA, 0, makeQuad(i), red);
+        }
+        size_t vertexCapacity = groups[0].quads.getVertices().capacity();
+        batch.clear();
+        check(batch.empty() && batch.getQuadCount() == 0, "batch clear: no quads");
+        check(groups.size() == 2 && groups[0].manager == nullptr && groups[1].manager == nullptr,
+              "batch clear: groups kept and marked free");
+        check(groups[0].quads.empty(), "batch clear: group emptied");
+        check(groups[0].quads.getVertices().capacity() == vertexCapacity, "batch clear: capacity kept");
+
+        batch.addQuad(&managerB, 0, makeQuad(0), blue);
+        check(groups.size() == 2 && groups[0].manager == &managerB, "batch clear: free group reused");
+        check(groups[0].quads.getVertices().capacity() == vertexCapacity, "batch clear: reused group keeps capacity");
+    }
+
+    // 非同期ラスタライズのグリフは、PreparedTextを描いているだけで（予算なしでも）いずれ表示される
+    void startAsyncPreparedText() {
+        FontAtlasOptions defaults = SharedFontCache::getInstance().getDefaultOptions();
+        FontAtlasOptions options = defaults;
+        options.asyncRasterization = true;
+        options.memoryBudget = 0;
+        options.maxAtlasCount = 0;
+        ofxTrueTypeFontLowRAM::setDefaultAtlasOptions(options);
+        bool loaded = asyncFont.load(fontPath, 27, true);  // 他のテストと別のアトラスにする
+        ofxTrueTypeFontLowRAM::setDefaultAtlasOptions(defaults);
+        if (!loaded) {
+            check(false, "async: font load");
+            return;
+        }
+
+        asyncText = asyncFont.prepare("Async");
+        check(asyncText.isPrepared(), "async: prepared");
+        check(!asyncFont.getAtlasManager()->isEvictionEnabled(), "async: no budget");
+        asyncFrames = 0;
+    }
+
+    void stepAsyncPreparedText() {
+        // 他の描画はせず、PreparedTextだけでフレームを進める
+        asyncText.draw(10, 40);
+        asyncFrames++;
+
+        bool done = asyncFont.getPendingGlyphCount() == 0 && asyncText.getQuadCount() == 5;
+        if (done || asyncFrames > 300) {
+            check(asyncFont.getPendingGlyphCount() == 0, "async: all glyphs rasterized");
+            check(asyncText.getQuadCount() == 5, "async: prepared text rebuilt with the placed glyphs");
+            asyncFrames = -1;
+        }
+    }
+};
+
+int main() {
+    ofGLWindowSettings settings;
+    settings.setSize(320, 240);
+    settings.setGLVersion(3, 2);
+    settings.windowMode = OF_WINDOW;
+    ofCreateWindow(settings);
+
+    ofRunApp(new ofApp());
+}